@@ -5,33 +5,182 @@
 
 
 /* Includes ------------------------------------------------------------------*/
+#ifndef HOST_BUILD
 #include "main.h"
-#include <vector>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#ifndef HOST_BUILD
 #include "stm32l4xx_hal.h"
+#else
+#include "tools/host_hal.h"   //PC build of the maze and planner code for the tools
+#endif
 
 /* Private variables ---------------------------------------------------------*/
-#define MAP_SIZE 16
-#define MOVE_STACK_SIZE 32
-#define WALL_THRESHOLD_S 500
+#ifndef MAP_SIZE
+#define MAP_SIZE 16                  // cells along a side, built with -DMAP_SIZE=32 for a half size maze
+#endif
+#define WALL_ROWS (MAP_SIZE*(MAP_SIZE+1))   // NORTH and SOUTH walls, the EAST and WEST ones are stored after them
+#define WALL_BYTES (2*WALL_ROWS/4)   // two bits per wall, every wall stored once for the cells either side
+#define WALL_CLOSED 0x01
+#define WALL_SEEN 0x02               // the wall has been sensed, closed or not
+#define CELL_FLAG_BYTES ((MAP_SIZE*MAP_SIZE+7)/8)
+#define MOVE_PROGRAM_SIZE 1024      // bytes of move program, a power of two so the ring indices wrap
+#define MOVE_UNIT_MM (CELL_MM/10)    // length unit of the straight and swept turn ops, ten encoder steps
+#define WALL_THRESHOLD_S 500         // raw count the uncalibrated IR tables put at the wall distance
 #define WALL_THRESHOLD_L 3000
+#define WALL_FRONT_MM 200            // middle sensor distance that counts as a wall ahead
+#define WALL_SIDE_MM 160             // front side sensor distance that counts as a wall to the side
+#define WALL_SAMPLES 8               // control ticks of wall readings each observation is taken over, a byte of history
+#define WALL_LANE_GUARDS 0x8000800080008000ULL   // top bit of each 16 bit sensor lane in sampleWalls()
+#define WALL_SENSED 0x0D             // sides the sensors see with the uMouse facing NORTH, all but behind
+#define WALL_VOTE_MAX 4              // a wall's confidence saturates here either way
+#define WALL_VOTE_CLOSE 2            // confidence that commits a wall closed
+#define WALL_VOTE_OPEN -2            // confidence that takes a committed wall back out
+#define IR_SENSORS 5
+#define IR_CAL_POINTS 12
+#define IR_CAL_START_MM 20           // distance to the wall at the first calibration point
+#define IR_CAL_STEP_MM 20            // distance driven back between calibration points, at most OP_LEN_MAX
+#define IR_CAL_SAMPLES 16            // control ticks averaged at each calibration point
+#define IR_CAL_SETTLE_MS 200
+#define IR_CAL_MAGIC 0x4952434C
+#define IR_CAL_ADDR 0x0803F800       // last flash page
+#define RUN_STORE_MAGIC 0x52554E50
+#define RUN_STORE_ADDR 0x0803F000    // flash page below the IR calibration
+#define LOG_ADDR 0x08020000          // input log, up to the stored run. The firmware has to fit below it
+#define LOG_BYTES (RUN_STORE_ADDR-LOG_ADDR)
+#define LOG_PAGE_BYTES 2048
+#define LOG_RING 1024                // log bytes the control tick can queue for the main loop to program
+#define LOG_TAG_START 0x80           // starts a logged program, its ticks follow as a bit stream
+#define LOG_CHECK_TICKS 1024         // ticks between check records
+#define LOG_BLANK 0xFF               // erased flash, skipped as padding
+#define LOG_FULL_STEPS 0x01          // full tick record flags, steps the short codes can't give, edges
+#define LOG_FULL_EDGES 0x02          // that went back and forth, wall readings that changed
+#define LOG_FULL_WALLS 0x04
+#define LOG_MARK_SWITCH 0            // records after a full tick code with no flags
+#define LOG_MARK_CHECK 1
+#define LOG_MARK_END 2
+#define LOG_MARK_CUT 3               // the ring overflowed and the ticks stop short
+#define LOG_ESCAPE 0x08              // nibble putting a whole 16 bit value in the next four
+#define LOG_PREDICT_TICKS 8          // ticks whose mean step count predicts the next tick's
+#define LOG_PREDICT_SHIFT 3
+#define LOG_TICK_MAX 48              // biggest tick record with a switch record and a check record
+#define DIST_MAX (MAP_SIZE*MAP_SIZE) // distance field value of a cell that can't reach the goal
+#define ASTAR_GOAL -1                // astarPath() target meaning any goal cell
+#define ASTAR_NONE 0xFFFF            // empty A* bucket list / no path found
+#define ASTAR_BUCKETS (DIST_MAX+2*MAP_SIZE)
+#define FRONTIER_SLACK_WEIGHT 4      // travel steps a frontier cell is worth per step it sits off the best possible path
 #define ONE_SQUARE 100
-#define TURN_INSIDE 10
-#define TURN_OUTSIDE 200
+#define TURN_INSIDE 10               // inner wheel steps of an in place 90 degree turn
+#define TURN_OUTSIDE 200             // outer wheel steps of an in place 90 degree turn
 #define TURN_AROUND 150
+#define CURVE_POINTS 32              // wheel duty steps along a swept turn
+#define CURVE_RAMP_MAX 80            // most of a swept turn, in %, that can be spent easing in and out
+#define CURVE_SPREAD_MAX 19661       // Q15 wheel duty spread at the tightest point of a CURVE_RAMP_MAX turn
+#define UTURN_RAMP_MAX 40            // longer ramps swing a U-turn more than 120 mm into its cells
+#define DIAG_MM 127                  // half a cell diagonal, edge middle to edge middle across a corner
+#define RUN_CURVES 32                // swept turns of different shapes one diagonal run can use
+#define RUN_SEGMENTS (MAP_SIZE*MAP_SIZE/2+2)   // straight lines a diagonal run can have, longer paths run as squares
+#define RUN_UTURN 4                  // runTurn value of a two cell U-turn, same sign as the turns
+#define EIGHTH_TURN 0x20000000       // binary angles
+#define QUARTER_TURN 0x40000000
+#define HALF_TURN 0x80000000
+#define SEARCH_SAMPLE_POINT 80       // steps into a search move where the walls ahead are sampled
+#define CELL_MM 180                  // size of one maze square
+#define WHEEL_TRACK_MM 72            // distance between the wheel contact points
+#define STEP_MM_Q8 (CELL_MM*256/ONE_SQUARE)   // wheel travel per encoder step, mm*256
+#define ANGLE_PER_STEP 17089132      // heading change per step of wheel difference, 2^32 per turn
+#define EDGE_OFFSET_MM 30            // distance from the centre to the cell edge when a side sensor loses the wall
+#define EDGE_WINDOW_MM 40            // largest position error a wall edge is allowed to correct
+#define EDGE_MAX_ANGLE 119304647     // 10 degrees, wall edges are ignored when turning
+#define CONTROL_RATE 1000            // control loop ticks per second
+#define EDGE_TIMER_HZ 1000000        // TIM2 rate, the encoder edges are timed with it
+#define EDGE_TIMES 8                 // edge times kept per wheel, a power of two of at least five
+#define SPEED_COUNT_TICKS 8          // ticks the edge counting speed is taken over, a power of two
+#define SPEED_BLEND_EDGES 64         // edges over SPEED_COUNT_TICKS where the speed is all edge counting
+#define SPEED_STOP_US 250000         // a wheel with no edge for this long has stopped
+#define TICK_US (EDGE_TIMER_HZ/CONTROL_RATE)   // control tick period in TIM2 counts
+#define CPU_IDLE_GAP_US 2            // a pass of the move loop taking longer than this was busy or interrupted
+#define EXTI_LINES 4                 // encoder interrupts counted, right A, right B, left A, left B
+#define PWM_PERIOD 256               // full on in the movementVector duty units, scaled to the TIM1 period when written
+#define PWM_MAX 255                  // largest duty the movementVector PWM fields can hold
+#define PWM_FREQ_HZ 20000            // TIM1 PWM rate, out of hearing. 4000 counts a period on the run clock
+#define MOTOR_COAST 0                // H-bridge modes, both inputs low and the wheels spin free
+#define MOTOR_DRIVE 1                // one input switching at the duty, the other low
+#define MOTOR_BRAKE 2                // both inputs high, the windings shorted
+#define MOTOR_R1_CCR CCR2            // bridge inputs, PA9 motor A1, PA10 A2, PA8 B1, PA11 B2
+#define MOTOR_R2_CCR CCR3
+#define MOTOR_L1_CCR CCR1
+#define MOTOR_L2_CCR CCR4
+#define CLOCK_IDLE 0                 // clock profiles, MSI at 4 MHz while waiting for the button
+#define CLOCK_RUN 1                  // main PLL at 80 MHz for mapping, planning and runs
+#define CLOCK_PROFILES 2
+#define BENCH_REPEATS 16             // passes TEST() times each planner over
 #define NORTH 0x0
 #define EAST 0x1
 #define SOUTH 0x2
 #define WEST 0x3
+#define IR_BL 0                      // IR sensor index, same as the ADC rank order
+#define IR_FL 1
+#define IR_M 2
+#define IR_FR 3
+#define IR_BR 4
 
-#define BASE_SPEED 60
+// move program ops, one byte each
+//   00000000  stop, the program ends here
+//   000000tt  turn in place, tt right turns
+//   00000100  half square in, edge of the cell to the middle
+//   00000101  half square out, middle of the cell to the edge
+//   001nnnnn  back up n mm at the safe duty
+//   01dnnnnn  straight of n MOVE_UNIT_MM, d set for a diagonal
+//   1laatttt  swept turn, l set for left, aa 45, 90 or 135 degrees or a U-turn through
+//             two cells, taking tttt MOVE_UNIT_MM of straight either side
+#define OP_STOP 0x00
+#define OP_SPIN 0x00
+#define OP_HALF_IN 0x04
+#define OP_HALF_OUT 0x05
+#define OP_BACK 0x20
+#define OP_STRAIGHT 0x40
+#define OP_DIAGONAL 0x60
+#define OP_TURN 0x80
+#define OP_LEFT 0x40
+#define OP_UTURN 0x30
+#define OP_LEN_MAX 31
+#define OP_TANGENT_MAX 15
+#define OP_CELL (OP_STRAIGHT|(CELL_MM/MOVE_UNIT_MM))
+#define OP_CURVE90 (OP_TURN|0x10|(CELL_MM/2/MOVE_UNIT_MM))
+
+#define PROFILE_SAFE 0
+#define PROFILE_MEDIUM 1
+#define PROFILE_AGGRESSIVE 2
 
 ADC_HandleTypeDef hadc1;
 TIM_HandleTypeDef htim1;
+TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim6;
+LPTIM_HandleTypeDef hlptim1;
+static uint8_t clockProfile = CLOCK_IDLE;
+
+// motor commands from the main loop, put on the bridges by the control tick. Duties are
+// signed, forward positive, in PWM_PERIOD units*256 so the accel ramp has fine steps
+static volatile uint8_t motorMode = MOTOR_COAST;
+static volatile int32_t motorTargetR = 0;
+static volatile int32_t motorTargetL = 0;
+static int32_t motorDutyR = 0;                  //where the ramp has got to
+static int32_t motorDutyL = 0;
+// TEST() planner times in us for each clock profile, read with the debugger: initDistField(),
+// astarPath() start to goal, chooseFrontier() from the start, pruneRegions(), genRunVector()
+static uint32_t plannerUs[CLOCK_PROFILES][5];
 
-static volatile uint32_t enCountRight = 0;
+static volatile uint32_t enCountRight = 0;   //every encoder edge, only the encoder handlers write these
 static volatile uint32_t enCountLeft = 0;
-static bool rightMotorFinish = 0;
-static bool leftMotorFinish = 0;
+static uint32_t enBaseRight = 0;             //edge count the current move started from
+static uint32_t enBaseLeft = 0;
+static volatile int32_t enPosRight = 0;     //signed quadrature position, forward is positive
+static volatile int32_t enPosLeft = 0;
+static int32_t lastEnPosRight = 0;
+static int32_t lastEnPosLeft = 0;
 
 static uint8_t currentXpos;
 static uint8_t currentYpos;
@@ -39,7 +188,13 @@ static uint8_t currentYpos;
 static uint8_t direction;
 static uint8_t defaultDir;
 
-enum Movement {noMove,forward,turnRight,turnLeft,turnAround};
+enum Movement {noMove,forward,turnRight,turnLeft,turnAround,curveRight,curveLeft,uTurnRight,uTurnLeft,halfSquareIn,halfSquareOut,diagonal,backUp};
+
+struct curveProfile {
+	uint16_t outerSteps;
+	uint16_t innerSteps;
+	uint16_t spread[CURVE_POINTS];   // Q15 wheel duty change from the centre duty, outer up and inner down
+};
 
 struct movementVector {
   uint8_t pwmR1;
@@ -49,6 +204,42 @@ struct movementVector {
   uint16_t rightMotorSteps;
   uint16_t leftMotorSteps;
   Movement moveType;
+  const curveProfile *curve;      // wheel duties along a swept turn, 0 for fixed duties
+};
+
+struct poseEstimate {
+	int32_t x;            // mm*256, grows toward WEST like the cell x index
+	int32_t y;            // mm*256, grows toward NORTH
+	uint32_t theta;       // binary angle, 2^32 is one turn, 0 is NORTH and turning right is positive
+};
+
+struct wheelTimer {
+	volatile uint32_t edgeTime[EDGE_TIMES];    // TIM2 time of the last edges, at edge count%EDGE_TIMES
+	uint32_t tickCount[SPEED_COUNT_TICKS];     // edge count at the last ticks, oldest at tick
+	uint8_t tick;
+	int32_t lastPos;                           // quadrature position at the last tick
+	int32_t sign;                              // the way the wheel last turned
+	int32_t speed;                             // edges per second*256, forward positive
+};
+
+// control loop and CPU load figures. Times are TIM2 us, late is how long after it was due a
+// tick started. The rates and idle are taken over whole seconds
+struct cpuLoad {
+	uint32_t ticks;
+	uint32_t execSum;
+	uint16_t execMax;
+	uint16_t lateMax;
+	uint32_t missed;                           // ticks that ended after the next was due, or never ran
+	uint32_t extiRate[EXTI_LINES];             // interrupts per second, the busiest second of a run
+	uint8_t idlePercent;                       // the busiest second of a run
+};
+
+struct speedProfile {
+	uint16_t straightPwm;   // duty on straights and half squares
+	uint16_t diagPwm;       // duty on diagonal straights of a speed run
+	uint16_t turnPwm;       // outer wheel duty of the in place turns and the turn around
+	uint32_t accel;         // largest duty change per second, ramped on the control tick
+	uint8_t curveRamp;      // % of a swept turn spent easing in and out, the rest is constant arc
 };
 
 struct analogValues {
@@ -59,58 +250,470 @@ struct analogValues {
 	uint16_t leftBackIRVal;
 };
 
-struct map {
+struct irCalibration {
+	uint32_t magic;
+	uint16_t raw[IR_SENSORS][IR_CAL_POINTS];   // raw counts at IR_CAL_START_MM + i*IR_CAL_STEP_MM from the wall
+	uint32_t spare;                            // pads to a whole number of flash double words
+};
+
+struct runStore {
+	uint32_t magic;
+	uint8_t profileIndex;                      // the program's turns were checked against this profile
+	uint8_t defaultDir;
+	uint16_t length;                           // program bytes, the last one is OP_STOP
+	uint8_t walls[WALL_BYTES];                 // map::walls and map::scanned
+	uint8_t scanned[CELL_FLAG_BYTES];
+	uint8_t program[MOVE_PROGRAM_SIZE];
+};
+
+// state at the start of a logged move program, followed in the log by the map and the program
+struct logSnapshot {
+	uint8_t xPos;
+	uint8_t yPos;
+	uint8_t direction;
+	uint8_t defaultDir;
+	uint8_t profileIndex;
+	uint8_t flags;                              // searchMode, goalReached, frontierScoring, regionPruning,
+	                                            // diagonalRuns from bit 0
+	uint16_t programLength;
+	irCalibration irCal;
+};
+
+// what the control tick works from, taken as logging starts and written after the program
+struct logState {
+	uint32_t enCountRight;
+	uint32_t enCountLeft;
+	uint32_t enBaseRight;
+	uint32_t enBaseLeft;
+	int32_t enPosRight;
+	int32_t enPosLeft;
+	int32_t lastEnPosRight;
+	int32_t lastEnPosLeft;
+	poseEstimate pose;
+	uint8_t switches;                           // switch 1, switch 2, button from bit 0
+	uint8_t wallSeen;                           // leftWallSeen, rightWallSeen from bit 0
+	uint8_t wallHistory[3];
+};
+
+// written every LOG_CHECK_TICKS ticks, so a program the log cut short can still be checked
+struct logCheck {
+	poseEstimate pose;
+	uint16_t progHead;                          // ops the move loop has taken, wrapped to the ring
+	uint16_t spare;
+};
+
+// state once the program has run, for the replay to check itself against
+struct logResult {
+	uint32_t enCountRight;                      // edge counts the last pass of the move loop saw
+	uint32_t enCountLeft;
+	poseEstimate pose;
+	uint32_t mapHash;                           // logMapHash()
+	uint32_t ticks;
 	uint8_t xPos;
 	uint8_t yPos;
-	uint16_t fillVal;
-	uint8_t walls;        // bits   X,X,X,X,NORTH,EAST,SOUTH,WEST  wall=1
-	bool scanned;
+	uint8_t direction;
+	uint8_t goalReached;
+};
+
+// cells are x*MAP_SIZE+y. The wall south of a cell is x*(MAP_SIZE+1)+y, the one east of
+// it WALL_ROWS+y*(MAP_SIZE+1)+x, so the edge of the maze has walls of its own
+struct map {
+	uint8_t walls[WALL_BYTES];                  // WALL_CLOSED, WALL_SEEN from bit 2*(wall%4)
+	uint8_t scanned[CELL_FLAG_BYTES];           // a bit per cell from bit 0
+	uint8_t pruned[CELL_FLAG_BYTES];            // explored by deduction, a pocket that can't be on a shortest run
+	int8_t votes[2*WALL_ROWS];                  // confidence a wall is there, WALL_VOTE_MAX either way
+	uint16_t fillVal[MAP_SIZE*MAP_SIZE];
+	uint16_t votedFrom;                         // cell*4+facing+1 mapCellAt() last voted from, 0 for none
 };
 
 static movementVector forwardMove;
 static movementVector turnRightMove;
 static movementVector turnLeftMove;
 static movementVector turnAroundMove;
+static movementVector curveRightMove;
+static movementVector curveLeftMove;
+static movementVector uTurnRightMove;
+static movementVector uTurnLeftMove;
+static movementVector halfInMove;
+static movementVector halfOutMove;
+static movementVector stopMove;
+
+// speed profiles picked with the switches in PROFILE SELECT MODE. Checked against the
+// timer and PWM ranges at compile time, so a bad entry won't build
+static constexpr speedProfile speedProfiles[] = {
+	//straight, diagonal, turn, accel, curve ramp
+	{60,  50,  60,  6000,  0},      // PROFILE_SAFE, the tuned values
+	{110, 90,  80,  15000, 40},     // PROFILE_MEDIUM
+	{150, 120, 110, 40000, 80}      // PROFILE_AGGRESSIVE
+};
+#define PROFILE_COUNT (sizeof(speedProfiles)/sizeof(speedProfiles[0]))
+
+constexpr uint16_t innerPwm(uint16_t outerPwm, uint16_t insideSteps, uint16_t outsideSteps)
+{
+	return outerPwm*insideSteps/outsideSteps;
+}
+
+constexpr bool profileValid(const speedProfile &p)
+{
+	//every duty fits the timer and the PWM fields, even the outer wheel at the tightest
+	//point of a swept turn, both wheels of a turn still move, and the ramp is at least
+	//one count and at most a full swing per control tick
+	return (p.straightPwm<=PWM_MAX)&&(p.diagPwm<=PWM_MAX)&&(p.diagPwm>0)&&(p.turnPwm<=PWM_MAX)&&
+	       (innerPwm(p.turnPwm,TURN_INSIDE,TURN_OUTSIDE)>0)&&
+	       (p.curveRamp<=CURVE_RAMP_MAX)&&
+	       ((uint32_t)p.straightPwm*(32768+CURVE_SPREAD_MAX)/32768<=PWM_MAX)&&
+	       ((uint32_t)p.straightPwm*(32768-CURVE_SPREAD_MAX)/32768>0)&&
+	       (p.accel>=CONTROL_RATE)&&(p.accel<=(uint32_t)PWM_PERIOD*CONTROL_RATE);
+}
+
+constexpr bool profilesValid(unsigned int i)
+{
+	return (i == PROFILE_COUNT)||(profileValid(speedProfiles[i])&&profilesValid(i+1));
+}
+
+static_assert(PWM_MAX<=PWM_PERIOD, "PWM_MAX is past full on");
+static_assert(TURN_INSIDE<=TURN_OUTSIDE, "the inside wheel of a turn travels the shortest");
+static_assert(profilesValid(0), "a speed profile is out of the timer or PWM range");
+
+static uint8_t profileIndex = PROFILE_SAFE;
+static const speedProfile *profile = &speedProfiles[PROFILE_SAFE];
+
+static curveProfile curve90;       // one cell, entry edge to side edge
+static curveProfile curve180;      // two side by side cells, entry edge of one to the same edge of the other
+
+// diagonal speed run, the path as straight segments with a turn between each pair
+static bool diagonalRuns = 1;                   //0 runs every route as squares, curves and U-turns
+static curveProfile runCurves[RUN_CURVES];      //the segments are planScratch.run
+// widest turn for 45, 90 and 135 degrees that still keeps to the middle of the path cells
+static const uint16_t runTurnMaxMM[4] = {0,DIAG_MM,CELL_MM/2,CELL_MM};
+static uint32_t runCurveAngle[RUN_CURVES];
+static uint16_t runCurveMM[RUN_CURVES];
+static uint8_t runCurveCount;
+
+// cell offsets for NORTH, EAST, SOUTH, WEST, matching setNewPos()
+static const int8_t dirDX[4] = {0,-1,0,1};
+static const int8_t dirDY[4] = {1,0,-1,0};
+
+static poseEstimate pose;
+static wheelTimer speedRight;
+static wheelTimer speedLeft;
+static bool leftWallSeen = 0;
+static bool rightWallSeen = 0;
+
+// control loop and CPU load, read with the debugger. cpuSecond is the last whole second,
+// cpuRun the move program running and cpuLastRun the summary of the one before. Idle time
+// is counted in the move loop and in HAL_Delay(), the waits the core stays awake through
+static cpuLoad cpuGather;                       //the second being gathered
+static cpuLoad cpuSecond;
+static cpuLoad cpuRun;
+static cpuLoad cpuLastRun;
+static volatile bool cpuRunning = 0;
+static volatile uint32_t extiCount[EXTI_LINES]; //every interrupt, only the EXTI handlers write these
+static uint32_t extiLast[EXTI_LINES];
+static volatile uint32_t idleUs = 0;            //only cpuIdle() writes this
+static uint32_t idleLast;
+static uint32_t idleSeen;
+static uint32_t tickDue;                        //TIM2 time the tick running was due
+
+// the last WALL_SAMPLES wall readings of the left front, middle and right front sensors,
+// newest in bit 0, and the side each sensor sees as a cellWalls() bit with the uMouse
+// facing NORTH
+static uint8_t wallHistory[3];
+static const uint8_t wallSensorSide[3] = {0x01,0x08,0x04};
+
+// what a history with a given number of wall readings votes. Six readings of eight
+// either way commit the wall on their own, a split history only leans
+static const int8_t wallVoteWeight[WALL_SAMPLES+1] = {-2,-2,-2,-1,0,1,2,2,2};
+
+// wall distance of each sensor in the lanes sampleWalls() compares, rightBackIRVal to
+// leftFrontIRVal from the bottom. The back sensors don't see walls and their lane is unused
+static const uint64_t wallLimits = ((uint64_t)WALL_SIDE_MM<<16)|((uint64_t)WALL_FRONT_MM<<32)|
+                                   ((uint64_t)WALL_SIDE_MM<<48);
+
+// set bits in a nibble, for counting the wall readings in a history
+static const uint8_t nibbleBits[16] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4};
+
+// sides as cellWalls() bits relative to the uMouse, as if it faced NORTH, turned to the
+// sides of the maze for each facing
+static const uint8_t wallRotate[4][16] = {
+	{0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xA, 0xB, 0xC, 0xD, 0xE, 0xF},
+	{0x0, 0x8, 0x1, 0x9, 0x2, 0xA, 0x3, 0xB, 0x4, 0xC, 0x5, 0xD, 0x6, 0xE, 0x7, 0xF},
+	{0x0, 0x4, 0x8, 0xC, 0x1, 0x5, 0x9, 0xD, 0x2, 0x6, 0xA, 0xE, 0x3, 0x7, 0xB, 0xF},
+	{0x0, 0x2, 0x4, 0x6, 0x8, 0xA, 0xC, 0xE, 0x1, 0x3, 0x5, 0x7, 0x9, 0xB, 0xD, 0xF}};
+
+static_assert(WALL_SAMPLES == 8, "the wall histories are counted a nibble at a time");
+static_assert((offsetof(analogValues,rightBackIRVal) == 0)&&(offsetof(analogValues,leftFrontIRVal) == 6),
+              "sampleWalls() reads the sensors as lanes in analogValues order");
+static_assert((IR_CAL_START_MM+(IR_CAL_POINTS-1)*IR_CAL_STEP_MM)*2<0x8000, "a sensor distance reaches a lane guard bit");
+
+// quarter wave of sin() in Q15, 64 steps per quarter turn
+static const int16_t sinTable[65] = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767};
+
+// goal cells, the distance field is flooded from all of them at once. Change for other maze variants
+static const uint8_t goalCells[][2] = {{MAP_SIZE/2-1,MAP_SIZE/2-1},{MAP_SIZE/2-1,MAP_SIZE/2},
+                                       {MAP_SIZE/2,MAP_SIZE/2-1},{MAP_SIZE/2,MAP_SIZE/2}};
+#define GOAL_COUNT (sizeof(goalCells)/sizeof(goalCells[0]))
+
+static bool searchMode = 0;
+static bool goalReached = 0;
+static bool frontierScoring = 1;                //0 goes back to the closest unscanned cell rule
+static bool regionPruning = 1;                  //0 never marks cells as pruned
+static uint16_t searchQueue[MAP_SIZE*MAP_SIZE];
+static uint8_t searchFrom[MAP_SIZE*MAP_SIZE];   //direction each cell was reached in, 0xFF if not reached
+static bool fieldQueued[MAP_SIZE*MAP_SIZE];
+static uint32_t astarExpanded = 0;              //cells expanded by the last astarPath()
+
+// working state of astarPath(), chooseFrontier(), pruneRegions() and pushDiagonalMoves().
+// They all run from the main loop and none of them needs its state once it returns, so
+// they share the memory, about 9 KB at 32x32 where separate arrays would take 27 KB
+static union {
+	struct {
+		uint16_t g[MAP_SIZE*MAP_SIZE];
+		uint16_t next[MAP_SIZE*MAP_SIZE];
+		uint16_t prev[MAP_SIZE*MAP_SIZE];
+		uint16_t bucket[ASTAR_BUCKETS];
+		uint8_t state[MAP_SIZE*MAP_SIZE];
+	} astar;
+	struct {
+		uint16_t fromStart[MAP_SIZE*MAP_SIZE];
+		uint16_t fromHere[MAP_SIZE*MAP_SIZE];
+	} frontier;
+	struct {
+		uint16_t order[MAP_SIZE*MAP_SIZE];
+		uint16_t low[MAP_SIZE*MAP_SIZE];
+		uint16_t cell[MAP_SIZE*MAP_SIZE];
+		uint8_t nextDir[MAP_SIZE*MAP_SIZE];
+		bool goal[MAP_SIZE*MAP_SIZE];
+	} prune;
+	struct {
+		uint8_t dir[RUN_SEGMENTS];
+		uint16_t len[RUN_SEGMENTS];
+		uint16_t chords[RUN_SEGMENTS];
+		int8_t turn[RUN_SEGMENTS];
+		uint16_t turnMM[RUN_SEGMENTS];
+		const curveProfile *curve[RUN_SEGMENTS];
+	} run;
+} planScratch;
+
+// A* open list, a bucket per f value holding a doubly linked list of cells
+static uint16_t (&astarG)[MAP_SIZE*MAP_SIZE] = planScratch.astar.g;
+static uint16_t (&astarNext)[MAP_SIZE*MAP_SIZE] = planScratch.astar.next;
+static uint16_t (&astarPrev)[MAP_SIZE*MAP_SIZE] = planScratch.astar.prev;
+static uint16_t (&astarBucket)[ASTAR_BUCKETS] = planScratch.astar.bucket;
+static uint8_t (&astarState)[MAP_SIZE*MAP_SIZE] = planScratch.astar.state;   //0 not seen, 1 open, 2 closed
+
+// flood distances used to score the frontier
+static uint16_t (&fromStart)[MAP_SIZE*MAP_SIZE] = planScratch.frontier.fromStart;
+static uint16_t (&fromHere)[MAP_SIZE*MAP_SIZE] = planScratch.frontier.fromHere;
+
+// depth first search state for finding pockets, indexed by cell or by visit order
+static uint16_t (&pruneOrder)[MAP_SIZE*MAP_SIZE] = planScratch.prune.order;  //visit number of each cell, 0xFFFF if not visited
+static uint16_t (&pruneLow)[MAP_SIZE*MAP_SIZE] = planScratch.prune.low;      //lowest visit number reachable without the edge in
+static uint16_t (&pruneCell)[MAP_SIZE*MAP_SIZE] = planScratch.prune.cell;    //cell at each visit number
+static uint8_t (&pruneNextDir)[MAP_SIZE*MAP_SIZE] = planScratch.prune.nextDir;
+static bool (&pruneGoal)[MAP_SIZE*MAP_SIZE] = planScratch.prune.goal;        //a goal cell was found below this cell
+
+// diagonal speed run, the path as straight segments with a turn between each pair
+static uint8_t (&runSegDir)[RUN_SEGMENTS] = planScratch.run.dir;          //heading in eighths of a turn, 0 is NORTH and right is positive
+static uint16_t (&runSegLen)[RUN_SEGMENTS] = planScratch.run.len;         //mm
+static uint16_t (&runSegChords)[RUN_SEGMENTS] = planScratch.run.chords;   //cell corners a diagonal segment cuts across, 0 if straight
+static int8_t (&runTurn)[RUN_SEGMENTS] = planScratch.run.turn;            //eighths of a turn after each segment, RUN_UTURN for a U-turn
+static uint16_t (&runTurnMM)[RUN_SEGMENTS] = planScratch.run.turnMM;      //straight each turn takes from the segments either side of it
+static const curveProfile *(&runSegCurve)[RUN_SEGMENTS] = planScratch.run.curve;   //shape of each turn, 0 for an in place turn
 
 analogValues analog1;
+analogValues wallDist;                 // analog1 converted to mm along each sensor beam
+
+static irCalibration irCal;
+
+// beam length per mm driven away from a wall facing the uMouse, 256 = 1. The back sensors
+// look sideways and can't see that wall, so the calibration pass leaves their tables alone
+static const uint16_t irBeamScale[IR_SENSORS] = {0,362,256,362,0};
+
+// moves waiting to run, queued at progTail by the main loop and run from progHead by the
+// control tick. Each side only writes its own index, so neither ever waits on the other
+static uint8_t moveProgram[MOVE_PROGRAM_SIZE];
+static volatile uint16_t progHead = 0;
+static volatile uint16_t progTail = 0;
+static int16_t opCarryMM[4] = {};      //distance the straights so far were rounded short by, along N, NE, E, SE
+
+// the move the control tick is running. The tick owns these while moveRunning is set
+static movementVector runningMove;
+static volatile bool moveRunning = 0;
+static volatile bool moveSampleDue = 0;     //the walls ahead are due to be sampled by the main loop
+static volatile bool moveStopped = 0;       //the program ended on a stop op
+static uint16_t moveSampleSteps;
+static uint16_t moveLastPoint;
+static bool moveSampled;
+static runStore savedRun;
 
-std::vector<movementVector> moveStack;
-std::vector<map> floodStack;
+// input log, the control tick records into the ring and the main loop programs it into flash
+static bool inputLogging = 1;          //0 leaves the log alone
+static uint8_t logRing[LOG_RING];
+static volatile uint16_t logIn = 0;
+static volatile uint16_t logOut = 0;
+static volatile bool logging = 0;
+static bool logArmed = 0;              //the log is erased and has room
+static uint32_t logUsed = 0;           //bytes programmed
+static uint32_t logTicks;
+static volatile bool logCut = 0;       //the tick stopped recording with the ring full
+static int32_t logPastRight[LOG_PREDICT_TICKS];   //positions the last ticks ended on, the oldest at logPastAt
+static int32_t logPastLeft[LOG_PREDICT_TICKS];
+static uint8_t logPastAt;
+static uint8_t logLastWalls;           //wall readings, left front, middle, right front from bit 0
+static int32_t logLastPosRight;
+static int32_t logLastPosLeft;
+static uint32_t logLastCountRight;
+static uint32_t logLastCountLeft;
+static uint8_t logLastSwitches;
+static uint16_t logStartHead;          //where the program started in the ring
+static uint32_t logBitBuf;             //tick record bits short of a whole byte
+static uint8_t logBitCount;
+#ifdef HOST_BUILD
+static uint8_t hostLog[LOG_BYTES];     //stands in for the log flash
+#endif
 
-map MAP [MAP_SIZE][MAP_SIZE] = {};    
+static_assert((LOG_RING&(LOG_RING-1)) == 0, "the log ring wraps on a power of two");
+static_assert(LOG_BYTES%LOG_PAGE_BYTES == 0, "the log is whole flash pages");
+static_assert(sizeof(logState)+1<LOG_RING-8, "the logged state is written in one go");
+
+static_assert((MOVE_PROGRAM_SIZE&(MOVE_PROGRAM_SIZE-1)) == 0, "the move program ring wraps on a power of two");
+static_assert(((EDGE_TIMES&(EDGE_TIMES-1)) == 0)&&(EDGE_TIMES>=5), "the edge times hold a quadrature cycle and wrap on a power of two");
+static_assert((SPEED_COUNT_TICKS&(SPEED_COUNT_TICKS-1)) == 0, "the tick counts wrap on a power of two");
+static_assert(CELL_MM%MOVE_UNIT_MM == 0, "a cell is a whole number of move units");
+static_assert(sizeof(runStore)<=IR_CAL_ADDR-RUN_STORE_ADDR, "the stored run is bigger than its flash page");
+static_assert(sizeof(runStore)%8 == 0, "flash is programmed in double words");
+
+static_assert((MAP_SIZE%2 == 0)&&(MAP_SIZE>=4)&&(MAP_SIZE<=64), "the goal is the middle four cells and cell coordinates are int8_t");
+
+static map MAP = {};
 
 /* Private function prototypes -----------------------------------------------*/
 void TEST(void);
 
+#ifndef HOST_BUILD
 void SystemClock_Config(void);
+static void setClockProfile(uint8_t);
+static void stopFor(uint16_t);
+static uint16_t lptimNow(void);
+static void benchPlanners(void);
 static void GPIO_Init(void);
 static void ADC1_Init(void);
 static void TIM1_Init(void);
+static void TIM2_Init(void);
+static void TIM6_Init(void);
+static void LPTIM1_Init(void);
 static void EXTI_Init(void);
+#endif
 static void Struct_Init(void);
 
                                     
 void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
                                 
-static void genMoveVector(void);
 static void genStartVector(void);
-static void genRunVector(void);
+static bool genRunVector(void);
+static uint16_t knownPath(int8_t,int8_t,int8_t,int8_t,uint8_t*);
 	
 static void exeMoveVector(void);
+static bool startMove(void);
+static void moveTick(uint32_t,uint32_t);
+static void cpuTick(uint32_t);
+static void cpuIdle(void);
+static void cpuRunStart(void);
+static void cpuRunEnd(void);
+static bool searchRun(void);
+static Movement genSearchMove(uint8_t,uint8_t,uint8_t);
+static void pushSearchMove(Movement);
+static void sampleAhead(void);
+static uint16_t searchSampleSteps(Movement);
 
 static void waitForButton(void);
 static void mapCell(void);
+static void mapCellAt(uint8_t,uint8_t,uint8_t);
 static int checkMapComplete(void);
 static void analogRead(void);
+static uint16_t irRawValue(uint8_t);
+static uint16_t irToMM(uint8_t,uint16_t);
+static void irLinearize(void);
+static void loadIRCal(void);
+static void calibrateIR(void);
+static void flashWrite(uint32_t,const void*,uint32_t);
 static void resetEnCounts(void);
 static void setMotorMove(movementVector);
-static void setNewPos(Movement);
+static void setMotorMode(uint8_t);
+static void motorTick(void);
+static void initPose(void);
+static void getPose(poseEstimate*);
+static void setPosFromPose(void);
+static int8_t poseToCell(int32_t);
+static void updatePose(void);
+static void updateWheelSpeeds(void);
+static int32_t wheelSpeed(wheelTimer*,uint32_t,int32_t);
+static void wallEdgeCorrect(void);
+static int32_t sinQ15(uint32_t);
+static void controlTick(void);
+static uint16_t astarPath(int8_t,int8_t,int8_t,int8_t,uint8_t*);
+static uint16_t astarH(int8_t,int8_t,int8_t,int8_t);
+static void astarInsert(uint16_t,uint16_t);
+static void astarRemove(uint16_t,uint16_t);
+static void pushPathMoves(const uint8_t*,uint16_t,uint8_t);
+static void floodDist(int8_t,int8_t,uint16_t*,bool);
+static uint16_t knownPathLength(void);
+static uint16_t chooseFrontier(int8_t,int8_t);
+static uint8_t nearestUnscannedDir(int8_t,int8_t,uint8_t);
+static bool isGoalCell(int8_t,int8_t);
+static uint16_t wallIndex(int8_t,int8_t,uint8_t);
+static uint8_t wallState(int8_t,int8_t,uint8_t);
+static uint8_t cellWalls(int8_t,int8_t);
+static void markWalls(int8_t,int8_t,uint8_t,uint8_t);
+static bool voteWall(uint16_t,int8_t);
+static void sampleWalls(void);
+static bool cellFlag(const uint8_t*,uint16_t);
+static void setCellFlag(uint8_t*,uint16_t);
+static bool wallOpen(int8_t,int8_t,uint8_t);
+static void initDistField(void);
+static void updateDistField(int8_t,int8_t);
+static void pruneRegions(void);
+static uint8_t bestFieldDir(int8_t,int8_t,uint8_t);
+static Movement relativeMove(uint8_t,uint8_t);
+static void pushTurnMove(uint8_t);
+static void buildCurve(curveProfile*,uint32_t,uint16_t,uint8_t);
+static void setCurveDuty(const movementVector&,uint16_t);
+static bool pushDiagonalMoves(const uint8_t*,uint16_t,uint8_t);
+static const curveProfile *runCurve(uint32_t,uint16_t);
+static void pushStraightOps(uint16_t,uint8_t);
+static void pushOp(uint8_t);
+static uint8_t popOp(void);
+static void clearMoves(void);
+static bool decodeOp(uint8_t,movementVector*);
+static void saveRun(void);
+static bool loadRun(void);
+static void logArm(void);
+static void logStart(void);
+static void logStop(void);
+static void logTick(uint32_t,uint32_t);
+static void logDrain(bool);
+static bool logPut(uint8_t);
+static void logWrite(const void*,uint16_t);
+static void logBits(uint32_t,uint8_t);
+static void logMark(uint8_t);
+static void logValue(int32_t);
+static uint8_t logSwitches(void);
+static uint32_t logMapHash(void);
 
+#ifndef HOST_BUILD
 /***********************************************************************************
 **                                   MAIN                                         **
 ***********************************************************************************/
 int main(void)
 {
+	bool explored;
+	
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
 
@@ -122,39 +725,16 @@ int main(void)
   ADC1_Init();
   TIM1_Init();
 	EXTI_Init();
+	TIM2_Init();
+	TIM6_Init();
+	LPTIM1_Init();
+#ifdef DEBUG
+	//keeps the debugger attached through stopFor(), at the cost of Stop 2's low current
+	DBGMCU->CR |= DBGMCU_CR_DBG_STOP;
+#endif
+	loadIRCal();
 	
-	forwardMove.pwmL1 = BASE_SPEED;
-	forwardMove.pwmL2 = 0;
-	forwardMove.pwmR1 = BASE_SPEED;
-	forwardMove.pwmR2 = 0;
-	forwardMove.leftMotorSteps = ONE_SQUARE;
-	forwardMove.rightMotorSteps = ONE_SQUARE;
-	forwardMove.moveType = forward;
-	
-	turnRightMove.pwmL1 = BASE_SPEED;
-	turnRightMove.pwmL2 = 0;
-	turnRightMove.pwmR1 = BASE_SPEED*(TURN_OUTSIDE/TURN_INSIDE);
-	turnRightMove.pwmR2 = 0;
-	turnRightMove.leftMotorSteps = TURN_OUTSIDE;
-	turnRightMove.rightMotorSteps = TURN_INSIDE;
-	turnRightMove.moveType = turnRight;
-	
-	turnLeftMove.pwmL1 = BASE_SPEED*(TURN_OUTSIDE/TURN_INSIDE);
-	turnLeftMove.pwmL2 = 0;
-	turnLeftMove.pwmR1 = BASE_SPEED;
-	turnLeftMove.pwmR2 = 0;
-	turnLeftMove.leftMotorSteps = TURN_INSIDE;
-	turnLeftMove.rightMotorSteps = TURN_OUTSIDE;
-	turnLeftMove.moveType = turnLeft;
-	
-	turnAroundMove.pwmL1 = BASE_SPEED;
-	turnAroundMove.pwmL2 = 0;
-	turnAroundMove.pwmR1 = 0;
-	turnAroundMove.pwmR2 = BASE_SPEED;
-	turnAroundMove.leftMotorSteps = TURN_AROUND;
-	turnAroundMove.rightMotorSteps = TURN_AROUND;
-	turnAroundMove.moveType = turnAround;
-	
+	Struct_Init();
 	
 	//TEST();
 
@@ -170,6 +750,8 @@ int main(void)
 	currentXpos = 0;
 	currentYpos = 0;
 	direction = defaultDir;
+	initPose();
+	initDistField();
   
 	waitForButton();
 	while(1)
@@ -177,35 +759,160 @@ int main(void)
 		//MAPPING MODE 00
 		while((GPIOB->IDR&0xC0) == 0x00) 
 		{
-			mapCell();
-			genMoveVector();
-			exeMoveVector();
-			while((checkMapComplete()==1)&&((GPIOB->IDR&0xC0) == 0x00))
+			//with nothing left to explore the map is as done as it gets, the goal may be walled off
+			explored = searchRun();
+			while(((checkMapComplete()==1)||(explored == 0))&&((GPIOB->IDR&0xC0) == 0x00))
 			{
-				if((currentXpos != 0)&&(currentYpos != 0)&&(direction != defaultDir))
+				if((currentXpos != 0)||(currentYpos != 0)||(direction != defaultDir))
 
 				{
 					genStartVector();
 					exeMoveVector();
 				}
 				HAL_GPIO_WritePin(GPIOA,GPIO_PIN_6,GPIO_PIN_SET);
-				HAL_Delay(500);
+				stopFor(500);
 				HAL_GPIO_WritePin(GPIOA,GPIO_PIN_6,GPIO_PIN_RESET);
-				HAL_Delay(500);
+				stopFor(500);
 			}
 		}
 		//SOLVE MODE 01
 		while((GPIOB->IDR&0xC0) == 0x40) 
 		{
 			waitForButton();
-			genRunVector();
+			
+			//the uMouse is put back in the start cell by hand
+			currentXpos = 0;
+			currentYpos = 0;
+			direction = defaultDir;
+			initPose();
+			if(loadRun() == 0)
+			{
+				if(genRunVector() == 0)
+				{
+					//no path to the goal is known wall for wall yet, go on searching instead
+					searchRun();
+					continue;
+				}
+				saveRun();
+			}
 			exeMoveVector();
 		}
+		//PROFILE SELECT MODE 10, each press steps to the next speed profile
+		while((GPIOB->IDR&0xC0) == 0x80) 
+		{
+			//blinks the number of the profile in use
+			for(uint8_t i = 0;i<=profileIndex;i++)
+			{
+				HAL_GPIO_WritePin(GPIOA,GPIO_PIN_6,GPIO_PIN_SET);
+				stopFor(200);
+				HAL_GPIO_WritePin(GPIOA,GPIO_PIN_6,GPIO_PIN_RESET);
+				stopFor(200);
+			}
+			waitForButton();
+			profileIndex = (profileIndex+1)%PROFILE_COUNT;
+			Struct_Init();
+		}
+		//IR CALIBRATION MODE 11
+		while((GPIOB->IDR&0xC0) == 0xC0) 
+		{
+			waitForButton();
+			calibrateIR();
+		}
 	}
 }
 /***********************************************************************************
 **                               MAIN END                                         **
 ***********************************************************************************/
+#endif
+
+/***********************************************************************************
+Function   :  Struct_Init()
+Description:  builds the movement structs and the swept turns from the speed profile
+              in use. The inside wheel of an in place turn runs slower by the ratio of
+              the wheel steps, so both wheels finish together
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void Struct_Init(void)
+{
+	profile = &speedProfiles[profileIndex];
+	buildCurve(&curve90,QUARTER_TURN,CELL_MM/2,profile->curveRamp);
+	buildCurve(&curve180,HALF_TURN,CELL_MM,(profile->curveRamp<UTURN_RAMP_MAX) ? profile->curveRamp : UTURN_RAMP_MAX);
+	
+	forwardMove.pwmL1 = profile->straightPwm;
+	forwardMove.pwmL2 = 0;
+	forwardMove.pwmR1 = profile->straightPwm;
+	forwardMove.pwmR2 = 0;
+	forwardMove.leftMotorSteps = ONE_SQUARE;
+	forwardMove.rightMotorSteps = ONE_SQUARE;
+	forwardMove.moveType = forward;
+	
+	turnRightMove.pwmL1 = profile->turnPwm;
+	turnRightMove.pwmL2 = 0;
+	turnRightMove.pwmR1 = innerPwm(profile->turnPwm,TURN_INSIDE,TURN_OUTSIDE);
+	turnRightMove.pwmR2 = 0;
+	turnRightMove.leftMotorSteps = TURN_OUTSIDE;
+	turnRightMove.rightMotorSteps = TURN_INSIDE;
+	turnRightMove.moveType = turnRight;
+	
+	turnLeftMove.pwmL1 = innerPwm(profile->turnPwm,TURN_INSIDE,TURN_OUTSIDE);
+	turnLeftMove.pwmL2 = 0;
+	turnLeftMove.pwmR1 = profile->turnPwm;
+	turnLeftMove.pwmR2 = 0;
+	turnLeftMove.leftMotorSteps = TURN_INSIDE;
+	turnLeftMove.rightMotorSteps = TURN_OUTSIDE;
+	turnLeftMove.moveType = turnLeft;
+	
+	turnAroundMove.pwmL1 = profile->turnPwm;
+	turnAroundMove.pwmL2 = 0;
+	turnAroundMove.pwmR1 = 0;
+	turnAroundMove.pwmR2 = profile->turnPwm;
+	turnAroundMove.leftMotorSteps = TURN_AROUND;
+	turnAroundMove.rightMotorSteps = TURN_AROUND;
+	turnAroundMove.moveType = turnAround;
+	
+	//swept turns run at the straight duty, setCurveDuty() spreads the wheels along the way
+	curveRightMove = forwardMove;
+	curveRightMove.leftMotorSteps = curve90.outerSteps;
+	curveRightMove.rightMotorSteps = curve90.innerSteps;
+	curveRightMove.moveType = curveRight;
+	curveRightMove.curve = &curve90;
+	
+	curveLeftMove = curveRightMove;
+	curveLeftMove.leftMotorSteps = curve90.innerSteps;
+	curveLeftMove.rightMotorSteps = curve90.outerSteps;
+	curveLeftMove.moveType = curveLeft;
+	
+	uTurnRightMove = curveRightMove;
+	uTurnRightMove.leftMotorSteps = curve180.outerSteps;
+	uTurnRightMove.rightMotorSteps = curve180.innerSteps;
+	uTurnRightMove.moveType = uTurnRight;
+	uTurnRightMove.curve = &curve180;
+	
+	uTurnLeftMove = uTurnRightMove;
+	uTurnLeftMove.leftMotorSteps = curve180.innerSteps;
+	uTurnLeftMove.rightMotorSteps = curve180.outerSteps;
+	uTurnLeftMove.moveType = uTurnLeft;
+	
+	halfInMove = forwardMove;
+	halfInMove.leftMotorSteps = ONE_SQUARE/2;
+	halfInMove.rightMotorSteps = ONE_SQUARE/2;
+	halfInMove.moveType = halfSquareIn;
+	
+	halfOutMove = halfInMove;
+	halfOutMove.moveType = halfSquareOut;
+	
+	stopMove.pwmL1 = 0;
+	stopMove.pwmL2 = 0;
+	stopMove.pwmR1 = 0;
+	stopMove.pwmR2 = 0;
+	stopMove.leftMotorSteps = 0;
+	stopMove.rightMotorSteps = 0;
+	stopMove.moveType = noMove;
+	stopMove.curve = 0;
+}
 
 /***********************************************************************************
 Function   :  TEST()
@@ -215,6 +922,9 @@ Outputs    :  None
 ***********************************************************************************/
 void TEST()
 {
+#ifndef HOST_BUILD
+	benchPlanners();
+#endif
 	while(1);
 }
 
@@ -228,79 +938,86 @@ Status     :  Complete, works as intended for the current implementation
 ***********************************************************************************/
 void mapCell(void)
 {
+	mapCellAt(currentXpos,currentYpos,direction);
+}
 
-	if(MAP[currentXpos][currentYpos].scanned == 1) //if current map position has not been mapped
-	{ 
-		MAP[currentXpos][currentYpos].scanned = 1;
-		analogRead();
-		switch(direction) 
-		{
-			case NORTH:
-				if(analog1.middleIRVal<=WALL_THRESHOLD_S)
-				{
-					MAP[currentXpos][currentYpos].walls|=0x08;
-				}
-				if(analog1.leftFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x01;
-				}
-				if(analog1.rightFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x04;
-				}
-				break;
-			case WEST:
-				if(analog1.middleIRVal<=WALL_THRESHOLD_S) 
-				{
+/***********************************************************************************
+Function   :  mapCellAt()
+Description:  votes on the walls of the given cell from the last WALL_SAMPLES readings
+              taken while facing the given direction. Used for the stationary scan and
+              for the walls sampled ahead of the uMouse during a search run. Every visit
+              from a new place votes again, so a wall seen from several places or from
+              both of its cells builds up confidence and one misread gets outvoted. Asked
+              again from the place it last voted from, it doesn't vote, since a uMouse
+              standing still would only count the same readings over again. The votes
+              are gathered as masks of the sides relative to the uMouse, which
+              wallRotate turns to the maze's, and each wall is stored once for both
+              its cells, so one pass over them votes for the neighbours as well
+Inputs     :  x, y, facing
+Outputs    :  None
 
-					MAP[currentXpos][currentYpos].walls|=0x01;
-				}
-				if(analog1.leftFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x02;
-				}
-				if(analog1.rightFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x08;
-				}
-				break;
-			case SOUTH:
-				if(analog1.middleIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x02;
-				}
-				if(analog1.leftFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x04;
-				}
-				if(analog1.rightFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x01;
-				}
-				break;
-			case EAST:
-				if(analog1.middleIRVal<=WALL_THRESHOLD_S) 
-				{
+Status     :  Complete
+***********************************************************************************/
+void mapCellAt(uint8_t x, uint8_t y, uint8_t facing)
+{
+	uint8_t oldWalls = cellWalls(x,y);
+	uint8_t seen = wallRotate[facing][WALL_SENSED];
+	uint8_t closed = 0;       //sides voting for a wall, against one and by two, relative at first
+	uint8_t open = 0;
+	uint8_t firm = 0;
+	int8_t vote;
+	uint8_t walls;
+	uint16_t wall;
+	bool removed = 0;
 
-					MAP[currentXpos][currentYpos].walls|=0x04;
-				}
-				if(analog1.leftFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x08;
-				}
-				if(analog1.rightFrontIRVal<=WALL_THRESHOLD_S) 
-				{
-					MAP[currentXpos][currentYpos].walls|=0x02;
-				}
-				break;
+	setCellFlag(MAP.scanned,x*MAP_SIZE+y);
+	if(MAP.votedFrom == (x*MAP_SIZE+y)*4+facing+1)
+	{
+		return;
+	}
+	MAP.votedFrom = (x*MAP_SIZE+y)*4+facing+1;
+	for(uint8_t s = 0;s<3;s++)
+	{
+		vote = wallVoteWeight[nibbleBits[wallHistory[s]&0x0F]+nibbleBits[wallHistory[s]>>4]];
+		closed |= (vote>0) ? wallSensorSide[s] : 0;
+		open |= (vote<0) ? wallSensorSide[s] : 0;
+		firm |= ((vote>1)||(vote<-1)) ? wallSensorSide[s] : 0;
+	}
+	closed = wallRotate[facing][closed];
+	open = wallRotate[facing][open];
+	firm = wallRotate[facing][firm];
+	for(uint8_t d = 0;d<4;d++)
+	{
+		if((seen&(0x08>>d)) != 0)
+		{
+			vote = ((closed&(0x08>>d)) != 0) ? 1 : ((open&(0x08>>d)) != 0) ? -1 : 0;
+			wall = wallIndex(x,y,d);
+			removed |= voteWall(wall,((firm&(0x08>>d)) != 0) ? 2*vote : vote);
 		}
 	}
+	
+	walls = cellWalls(x,y);
+	if(removed)
+	{
+		//a wall taken out can shorten paths anywhere and open up a pruned pocket
+		memset(MAP.pruned,0,sizeof(MAP.pruned));
+		initDistField();
+		pruneRegions();
+	}
+	else if(walls != oldWalls)
+	{
+		//new walls only change the distance field around this cell
+		updateDistField(x,y);
+		pruneRegions();
+	}
 }
 
 /***********************************************************************************
 Function   :  waitForButton()
 Description:  runs loop waiting for the button to be pressed. After the
               button is pressed, it will delay for 3 seconds then return.
+              The input log is made ready for the runs that follow. The wait is
+              spent on the idle clock, everything after it on the run clock
 Inputs     :  None
 Outputs    :  None
 
@@ -308,18 +1025,40 @@ Status     :  Complete
 ***********************************************************************************/
 void waitForButton(void)
 {
-	//loop while button is not pressed 
+	uint32_t start;
+	
+	setMotorMode(MOTOR_COAST);
+#ifndef HOST_BUILD
+	setClockProfile(CLOCK_IDLE);
+#endif
+	//loop while button is not pressed, stopped until the button's interrupt
 	while((GPIOA->IDR&0x1000)==0x0000)
 	{
-		//empty on purpose
+#ifndef HOST_BUILD
+		stopFor(0);
+#endif
+	}
+#ifndef HOST_BUILD
+	setClockProfile(CLOCK_RUN);
+#endif
+	//delay for final adjustments, the input log is erased while the hand moves away
+	start = HAL_GetTick();
+	logArm();
+	if(HAL_GetTick()-start<3000)
+	{
+		HAL_Delay(3000-(HAL_GetTick()-start));
 	}
-	//delay for final adjustments
-	HAL_Delay(3000);
 }
 
 /***********************************************************************************
 Function   :  exeMoveVector()
-Description:  runs the motors to move to the next cell
+Description:  runs the move program. The first move is started here and the control
+              tick runs the rest, each op expanded into the wheel steps and duties of
+              its move as it comes up, so moves are chained without a gap and the
+              motors only stop once the program is empty or reaches a stop. During a
+              search run the tick asks for the walls ahead to be sampled part way
+              through each move and the main loop queues the next move, which the
+              tick switches to as soon as both are done
 Inputs     :  None
 Outputs    :  None
 
@@ -327,861 +1066,3904 @@ Status     :  Mostly Complete, needs movement control system code
 ***********************************************************************************/
 void exeMoveVector(void)
 {
-	movementVector currentMove;
+	resetEnCounts();                    //resets the encoder counters 
+	logStart();
+	cpuRunStart();
+	moveStopped = 0;
+	moveSampleDue = 0;
 	
-	//Repeats while there is still movements on the stack to be executed
-	while(moveStack.empty() == 0)
+	//the tick only picks the move up once it has been set up
+	if(startMove() == 1)
+	{
+		__DMB();
+		moveRunning = 1;
+	}
+	while(moveRunning == 1)
 	{
-		currentMove = moveStack.back();   //gets the next movement to execute
-		moveStack.pop_back();             //deletes the movement we loaded off the stack
-		rightMotorFinish = 0;             //clears movement complete flags
-		leftMotorFinish = 0;
-		resetEnCounts();                  //resets the encoder counters 
-		setMotorMove(currentMove);        //sets the PWMs for the movement
-		setNewPos(currentMove.moveType);  //sets the position of the uM to the destination
+#ifdef HOST_BUILD
+		hostIdle();                     //the host tools step the encoders and the control tick here
+#endif
+		cpuIdle();
+		logDrain(0);
 		
-		//loops until the movement has completed
-		while((rightMotorFinish == 0)&&(leftMotorFinish))
+		//movement control system goes here
+		
+		//cleared once the next move is queued, the tick holds the move until then
+		if(moveSampleDue == 1)
 		{
-			//movement control system goes here
-			
-			//checks to see if the movement is done
-			if(currentMove.rightMotorSteps<=enCountRight)
-			{
-				rightMotorFinish = 1;
-			}
-			if(currentMove.leftMotorSteps<=enCountLeft)
-			{
-				leftMotorFinish = 1;
-			}
+			sampleAhead();
+			moveSampleDue = 0;
 		}
 	}
+	
+	//anything queued after a stop is dropped
+	if(moveStopped == 1)
+	{
+		clearMoves();
+	}
+	setMotorMove(stopMove);
+	cpuRunEnd();
+	logStop();
 }
 
 /***********************************************************************************
-Function   :  checkMapComplete()
-Description:  Checks to see if the current floodfill solution to the maze has all 
-              cells in the path mapped
+Function   :  startMove()
+Description:  takes the next op off the move program and sets the wheels going on
+              its move. Called by exeMoveVector() for the first move and by the
+              control tick after that. Swept turns are built when their program is
+              planned, so decoding one here only looks it up
 Inputs     :  None
-Outputs    :  returns a 1 or 0
+Outputs    :  1 if a move was started, 0 at the end of the program
 
-Status     :  Not Started
+Status     :  Complete
 ***********************************************************************************/
-int checkMapComplete(void)
+bool startMove(void)
 {
-	return 0;
+	if(progHead == progTail)
+	{
+		return 0;
+	}
+	if(decodeOp(popOp(),&runningMove) == 0)
+	{
+		moveStopped = 1;
+		return 0;
+	}
+	moveSampled = 0;
+	moveSampleSteps = searchSampleSteps(runningMove.moveType);
+	moveLastPoint = 0;
+	if(runningMove.curve != 0)
+	{
+		setCurveDuty(runningMove,0);
+	}
+	else
+	{
+		setMotorMove(runningMove);      //sets the PWMs for the movement
+	}
+	return 1;
 }
 
 /***********************************************************************************
-Function   :  setMotorMove()
-Description:  Sets the PWMs up for the next movement 
-Inputs     :  move
+Function   :  moveTick()
+Description:  runs the current move from the control tick. Steps the duties along a
+              swept turn, flags the wall sample for the main loop, and when both
+              wheels are done starts the next move in the same tick. Brakes once
+              the program runs out
+Inputs     :  right and left edge counts at the start of the tick
 Outputs    :  None
 
-Status     :  Not Started
+Status     :  Complete
 ***********************************************************************************/
-void setMotorMove(movementVector move)
+void moveTick(uint32_t right, uint32_t left)
 {
+	uint16_t point;
+	
+	if(moveRunning == 0)
+	{
+		return;
+	}
+	right -= enBaseRight;
+	left -= enBaseLeft;
+	
+	//samples the walls ahead at a fixed point of the move, the main loop queues the next move
+	if((searchMode == 1)&&(moveSampled == 0)&&(moveSampleSteps != 0)&&
+	   ((right>=moveSampleSteps)||(left>=moveSampleSteps)))
+	{
+		moveSampled = 1;
+		moveSampleDue = 1;
+	}
+	
+	//keeps the overshoot so chained moves don't lose distance. A search move that samples at
+	//its end carries on at its duties until the main loop has queued what comes next
+	while((runningMove.rightMotorSteps<=right)&&(runningMove.leftMotorSteps<=left))
+	{
+		if((moveSampleDue == 1)&&(progHead == progTail))
+		{
+			break;
+		}
+		enBaseRight += runningMove.rightMotorSteps;
+		enBaseLeft += runningMove.leftMotorSteps;
+		right -= runningMove.rightMotorSteps;
+		left -= runningMove.leftMotorSteps;
+		setPosFromPose();                 //the cell and direction come from the odometry
+		if(startMove() == 0)
+		{
+			setMotorMove(stopMove);
+			moveRunning = 0;
+			return;
+		}
+	}
 	
+	//steps the wheel duties along a swept turn by the distance the centre has covered
+	if(runningMove.curve != 0)
+	{
+		point = (right+left)*CURVE_POINTS/(runningMove.rightMotorSteps+runningMove.leftMotorSteps);
+		if(point != moveLastPoint)
+		{
+			moveLastPoint = point;
+			setCurveDuty(runningMove,point);
+		}
+	}
 }
 
 /***********************************************************************************
-Function   :  resetFillVals()
-Description:  Resets the floodfill values to prevent old flood fill instances from 
-              interfering with the current process
-Inputs     :  None
+Function   :  pushOp()
+Description:  queues an op at the end of the move program
+Inputs     :  op
 Outputs    :  None
 
 Status     :  Complete
 ***********************************************************************************/
-void resetFillVals(void)
+void pushOp(uint8_t op)
 {
-	for(int i = 0;i<MAP_SIZE;i++)
+	if(((progTail+1)&(MOVE_PROGRAM_SIZE-1)) == progHead)
 	{
-		for(int j = 0;j<MAP_SIZE;j++)
-		{
-			MAP[i][j].fillVal = 0;
-		}
+		//should never happen, the longest run of the maze fits
+		while(1){}
 	}
+	moveProgram[progTail] = op;
+	__DMB();                            //the op is in the ring before the tick can see it
+	progTail = (progTail+1)&(MOVE_PROGRAM_SIZE-1);
 }
 
 /***********************************************************************************
-Function   :  genMoveVector()
-Description:  generates the movement steps to get to the next unmapped cell of the maze
+Function   :  popOp()
+Description:  takes the next op off the front of the move program
 Inputs     :  None
-Outputs    :  None
-
+Outputs    :  op, OP_STOP if the program is empty
 
-Status     :  mostly done, will have errors because it doesn't account for starting direction of uMouse
+Status     :  Complete
 ***********************************************************************************/
-void genMoveVector(void)
+uint8_t popOp(void)
 {
-	//reset the fillVals so that past iterations of flood fill dont interfere
-	resetFillVals();
-	map workingCell, targetCell, previousCell,nextCell;
-	bool targetPosFound = 0;
-	bool turned = 0;
+	uint8_t op;
 	
-	//load current position as the starting point and set fillVal
-	MAP[currentXpos][currentYpos].fillVal = 0x8000;
-	floodStack.insert(0,MAP[currentXpos][currentYpos]);
-	
-	//while the destination hasn't been found yet
-	while(targetPosFound == 0)
+	if(progHead == progTail)
 	{
-		//load a cell off the stack 
-		workingCell = floodStack.back();
-		floodStack.pop_back();
-		
-		//if the cell that was loaded has not been scanned, set as destination
-		if(workingCell.scanned == 0)
+		return OP_STOP;
+	}
+	__DMB();                            //the op is read after the tail that covers it
+	op = moveProgram[progHead];
+	progHead = (progHead+1)&(MOVE_PROGRAM_SIZE-1);
+	return op;
+}
+
+/***********************************************************************************
+Function   :  clearMoves()
+Description:  empties the move program and starts a new one
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void clearMoves(void)
+{
+	progHead = 0;
+	progTail = 0;
+	memset(opCarryMM,0,sizeof(opCarryMM));
+}
+
+/***********************************************************************************
+Function   :  decodeOp()
+Description:  expands a move program op into the steps and duties of its move. The
+              swept turns come from the shapes already built for the speed profile
+Inputs     :  op, move to fill
+Outputs    :  0 for a stop, or a turn too tight for the speed profile
+
+Status     :  Complete
+***********************************************************************************/
+bool decodeOp(uint8_t op, movementVector *move)
+{
+	const curveProfile *curve;
+	uint16_t mm;
+	
+	if((op&OP_TURN) != 0)
+	{
+		if((op&OP_UTURN) == OP_UTURN)
+		{
+			*move = ((op&OP_LEFT) != 0) ? uTurnLeftMove : uTurnRightMove;
+			return 1;
+		}
+		mm = (op&OP_TANGENT_MAX)*MOVE_UNIT_MM;
+		if(op == (OP_CURVE90|(op&OP_LEFT)))
+		{
+			curve = &curve90;
+		}
+		else
+		{
+			curve = runCurve((uint32_t)(((op>>4)&0x03)+1)*EIGHTH_TURN,mm);
+		}
+		if(curve == 0)
+		{
+			*move = stopMove;
+			return 0;
+		}
+		*move = ((op&OP_LEFT) != 0) ? curveLeftMove : curveRightMove;
+		move->curve = curve;
+		move->leftMotorSteps = ((op&OP_LEFT) != 0) ? curve->innerSteps : curve->outerSteps;
+		move->rightMotorSteps = ((op&OP_LEFT) != 0) ? curve->outerSteps : curve->innerSteps;
+		return 1;
+	}
+	if((op&OP_STRAIGHT) != 0)
+	{
+		*move = forwardMove;
+		move->leftMotorSteps = (op&OP_LEN_MAX)*MOVE_UNIT_MM*ONE_SQUARE/CELL_MM;
+		move->rightMotorSteps = move->leftMotorSteps;
+		if((op&OP_DIAGONAL) == OP_DIAGONAL)
+		{
+			move->pwmL1 = profile->diagPwm;
+			move->pwmR1 = profile->diagPwm;
+			move->moveType = diagonal;
+		}
+		return 1;
+	}
+	if((op&OP_BACK) != 0)
+	{
+		//always backs away slowly, whatever profile is picked
+		*move = stopMove;
+		move->pwmL2 = speedProfiles[PROFILE_SAFE].straightPwm;
+		move->pwmR2 = speedProfiles[PROFILE_SAFE].straightPwm;
+		move->leftMotorSteps = (op&OP_LEN_MAX)*ONE_SQUARE/CELL_MM;
+		move->rightMotorSteps = move->leftMotorSteps;
+		move->moveType = backUp;
+		return 1;
+	}
+	switch(op)
+	{
+		case OP_SPIN|1:
+			*move = turnRightMove;
+			return 1;
+		case OP_SPIN|2:
+			*move = turnAroundMove;
+			return 1;
+		case OP_SPIN|3:
+			*move = turnLeftMove;
+			return 1;
+		case OP_HALF_IN:
+			*move = halfInMove;
+			return 1;
+		case OP_HALF_OUT:
+			*move = halfOutMove;
+			return 1;
+		default:
+			*move = stopMove;
+			return 0;
+	}
+}
+
+/***********************************************************************************
+Function   :  searchRun()
+Description:  explores the maze without stopping in each cell. The start cell is
+              scanned at rest, after that each move runs from the entry edge of a cell
+              to its exit edge and the walls of the next cell are sampled on the way,
+              so turns are taken as smooth search arcs. Returns once no unscanned
+              cell can be reached
+Inputs     :  None
+Outputs    :  1 if the uMouse moved, 0 if there was nothing to explore from here
+
+Status     :  Complete, waiting on the motor control code to be tuned
+***********************************************************************************/
+bool searchRun(void)
+{
+	Movement startMove;
+	
+	mapCell();
+	startMove = genSearchMove(currentXpos,currentYpos,direction);
+	if(startMove == noMove)
+	{
+		return 0;
+	}
+	
+	//turns in place in the start cell, then drives out to its edge
+	searchMode = 1;
+	switch(startMove)
+	{
+		case turnRight:
+			pushTurnMove(1);
+			break;
+		case turnLeft:
+			pushTurnMove(3);
+			break;
+		case turnAround:
+			pushTurnMove(2);
+			break;
+		default:
+			break;
+	}
+	pushOp(OP_HALF_OUT);
+	exeMoveVector();
+	searchMode = 0;
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  sampleAhead()
+Description:  maps the cell the uMouse is about to enter from the odometry pose and
+              pushes the move that takes it through that cell
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void sampleAhead(void)
+{
+	poseEstimate now;
+	int8_t x, y;
+	
+	setPosFromPose();
+	getPose(&now);
+	
+	//the cell ahead is the one half a square in front of the uMouse
+	x = poseToCell(now.x+dirDX[direction]*CELL_MM*128);
+	y = poseToCell(now.y+dirDY[direction]*CELL_MM*128);
+	
+	//should never happen, there is always a wall on the edge of the maze
+	if((x<0)||(y<0))
+	{
+		return;
+	}
+	mapCellAt(x,y,direction);
+	pushSearchMove(genSearchMove(x,y,direction));
+}
+
+/***********************************************************************************
+Function   :  pushSearchMove()
+Description:  queues the moves that take the uMouse through the cell it is entering.
+              A dead end is driven into and back out of, and when there is nothing
+              left to explore the uMouse stops in the middle of the cell
+Inputs     :  move relative to the current direction
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void pushSearchMove(Movement move)
+{
+	switch(move)
+	{
+		case forward:
+			pushOp(OP_CELL);
+			break;
+		case turnRight:
+			pushOp(OP_CURVE90);
+			break;
+		case turnLeft:
+			pushOp(OP_CURVE90|OP_LEFT);
+			break;
+		case turnAround:
+			pushOp(OP_HALF_IN);
+			pushOp(OP_SPIN|2);
+			pushOp(OP_HALF_OUT);
+			break;
+		default:
+			pushOp(OP_HALF_IN);
+			break;
+	}
+}
+
+/***********************************************************************************
+Function   :  searchSampleSteps()
+Description:  gives the encoder step of a move at which the walls ahead are sampled
+Inputs     :  Movement
+Outputs    :  steps, 0 if the move doesn't sample
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t searchSampleSteps(Movement move)
+{
+	switch(move)
+	{
+		case forward:
+			return SEARCH_SAMPLE_POINT;
+		case curveRight:
+		case curveLeft:
+			return curve90.outerSteps;
+		case halfSquareOut:
+			return ONE_SQUARE/2;
+		default:
+			return 0;
+	}
+}
+
+/***********************************************************************************
+Function   :  genSearchMove()
+Description:  picks the move through a cell during a search run. Until the goal is
+              reached it steps down the distance field. After that it heads for the
+              best scoring frontier cell, and stops once the shortest path is proven
+Inputs     :  x, y, facing
+Outputs    :  move relative to facing, noMove if nothing is left to explore
+
+Status     :  Complete
+***********************************************************************************/
+Movement genSearchMove(uint8_t x, uint8_t y, uint8_t facing)
+{
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	uint16_t target;
+	uint8_t firstDir;
+	
+	if(isGoalCell(x,y))
+	{
+		goalReached = 1;
+	}
+	if(goalReached == 0)
+	{
+		firstDir = bestFieldDir(x,y,facing);
+		if(firstDir <= WEST)
+		{
+			return relativeMove(firstDir,facing);
+		}
+		//the goal is walled off, explore what's left instead
+		goalReached = 1;
+	}
+	
+	if(frontierScoring == 0)
+	{
+		firstDir = nearestUnscannedDir(x,y,facing);
+		return (firstDir <= WEST) ? relativeMove(firstDir,facing) : noMove;
+	}
+	
+	target = chooseFrontier(x,y);
+	if((target == ASTAR_NONE)||(astarPath(x,y,target/MAP_SIZE,target%MAP_SIZE,path) == ASTAR_NONE))
+	{
+		return noMove;
+	}
+	return relativeMove(path[0],facing);
+}
+
+/***********************************************************************************
+Function   :  nearestUnscannedDir()
+Description:  floods out from a cell to the closest unscanned cell and gives the
+              direction of the first step toward it
+Inputs     :  x, y, facing
+Outputs    :  direction, 0xFF if every reachable cell is scanned
+
+Status     :  Complete
+***********************************************************************************/
+uint8_t nearestUnscannedDir(int8_t x, int8_t y, uint8_t facing)
+{
+	uint16_t head = 0;
+	uint16_t tail = 0;
+	int8_t cx = x;
+	int8_t cy = y;
+	int8_t nx, ny;
+	uint8_t firstDir = facing;
+	bool targetPosFound = 0;
+	
+	memset(searchFrom,0xFF,sizeof(searchFrom));
+	searchFrom[x*MAP_SIZE+y] = facing;
+	searchQueue[tail++] = x*MAP_SIZE+y;
+	
+	//the cell being searched from has just been scanned, so only its neighbours count
+	while((head != tail)&&(targetPosFound == 0))
+	{
+		cx = searchQueue[head]/MAP_SIZE;
+		cy = searchQueue[head]%MAP_SIZE;
+		head++;
+		if((cellFlag(MAP.scanned,cx*MAP_SIZE+cy) == 0)&&(cellFlag(MAP.pruned,cx*MAP_SIZE+cy) == 0))
+		{
+			targetPosFound = 1;
+			break;
+		}
+		for(int d = 0;d<4;d++)
+		{
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			if(wallOpen(cx,cy,d)&&(searchFrom[nx*MAP_SIZE+ny] == 0xFF))
+			{
+				searchFrom[nx*MAP_SIZE+ny] = d;
+				searchQueue[tail++] = nx*MAP_SIZE+ny;
+			}
+		}
+	}
+	if(targetPosFound == 0)
+	{
+		return 0xFF;
+	}
+	
+	//walks back from the target to the cell next to the start
+	while((cx != x)||(cy != y))
+	{
+		firstDir = searchFrom[cx*MAP_SIZE+cy];
+		cx -= dirDX[firstDir];
+		cy -= dirDY[firstDir];
+	}
+	return firstDir;
+}
+
+/***********************************************************************************
+Function   :  chooseFrontier()
+Description:  scores every unscanned cell that could still shorten the run. A cell
+              can't help if even with every unknown wall open, the best path through
+              it is no shorter than the path already proven through scanned cells.
+              The rest are scored by the travel to reach them plus how far they sit
+              off the best possible path, so the uMouse prefers cheap cells that lie
+              on a likely shortest route
+Inputs     :  x, y of the uMouse
+Outputs    :  cell index, ASTAR_NONE if no cell can shorten the run
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t chooseFrontier(int8_t x, int8_t y)
+{
+	uint16_t known = knownPathLength();
+	uint16_t best = ASTAR_NONE;
+	uint32_t bestScore = 0xFFFFFFFF;
+	uint32_t score;
+	uint16_t through;
+	
+	floodDist(0,0,fromStart,0);
+	floodDist(x,y,fromHere,0);
+	for(uint16_t cell = 0;cell<MAP_SIZE*MAP_SIZE;cell++)
+	{
+		if((cellFlag(MAP.scanned,cell) == 1)||(cellFlag(MAP.pruned,cell) == 1)||
+		   (fromHere[cell] == DIST_MAX))
+		{
+			continue;
+		}
+		through = fromStart[cell]+MAP.fillVal[cell];
+		if(through>=known)
+		{
+			continue;
+		}
+		score = fromHere[cell]+FRONTIER_SLACK_WEIGHT*(through-MAP.fillVal[0]);
+		if(score<bestScore)
+		{
+			bestScore = score;
+			best = cell;
+		}
+	}
+	return best;
+}
+
+/***********************************************************************************
+Function   :  knownPathLength()
+Description:  length of the shortest start to goal path through scanned cells only.
+              Every wall of a scanned cell is known, so this path is certain
+Inputs     :  None
+Outputs    :  steps, DIST_MAX if there is no such path yet
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t knownPathLength(void)
+{
+	uint16_t shortest = DIST_MAX;
+	
+	floodDist(0,0,fromHere,1);
+	for(uint8_t i = 0;i<GOAL_COUNT;i++)
+	{
+		if(fromHere[goalCells[i][0]*MAP_SIZE+goalCells[i][1]]<shortest)
+		{
+			shortest = fromHere[goalCells[i][0]*MAP_SIZE+goalCells[i][1]];
+		}
+	}
+	return shortest;
+}
+
+/***********************************************************************************
+Function   :  floodDist()
+Description:  breadth first flood of step counts out from one cell
+Inputs     :  x, y, distance buffer, 1 to only flood through scanned cells
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void floodDist(int8_t x, int8_t y, uint16_t *dist, bool scannedOnly)
+{
+	uint16_t head = 0;
+	uint16_t tail = 0;
+	int8_t cx, cy, nx, ny;
+	
+	for(uint16_t cell = 0;cell<MAP_SIZE*MAP_SIZE;cell++)
+	{
+		dist[cell] = DIST_MAX;
+	}
+	dist[x*MAP_SIZE+y] = 0;
+	searchQueue[tail++] = x*MAP_SIZE+y;
+	while(head != tail)
+	{
+		cx = searchQueue[head]/MAP_SIZE;
+		cy = searchQueue[head]%MAP_SIZE;
+		head++;
+		for(int d = 0;d<4;d++)
+		{
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			if(wallOpen(cx,cy,d)&&(dist[nx*MAP_SIZE+ny] == DIST_MAX)&&
+			   ((scannedOnly == 0)||(cellFlag(MAP.scanned,nx*MAP_SIZE+ny) == 1)))
+			{
+				dist[nx*MAP_SIZE+ny] = dist[cx*MAP_SIZE+cy]+1;
+				searchQueue[tail++] = nx*MAP_SIZE+ny;
+			}
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  relativeMove()
+Description:  gives the turn needed to head in a direction
+Inputs     :  direction wanted, current facing
+Outputs    :  forward, turnRight, turnLeft or turnAround
+
+Status     :  Complete
+***********************************************************************************/
+Movement relativeMove(uint8_t dir, uint8_t facing)
+{
+	switch((dir-facing)&0x03)
+	{
+		case 0:  return forward;
+		case 1:  return turnRight;
+		case 2:  return turnAround;
+		default: return turnLeft;
+	}
+}
+
+/***********************************************************************************
+Function   :  pushTurnMove()
+Description:  queues the in place turn for a change of direction
+Inputs     :  turn, number of right turns (0 to 3)
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void pushTurnMove(uint8_t turn)
+{
+	if((turn&0x03) != 0)
+	{
+		pushOp(OP_SPIN|(turn&0x03));
+	}
+}
+
+/***********************************************************************************
+Function   :  buildCurve()
+Description:  works out a swept turn. The curvature eases in along a sin^2 ramp,
+              holds for the constant arc, and eases back out, so the wheels never
+              jump from straight to turning. The shape is walked with the heading
+              integrated point by point to find how far it moves sideways, then
+              scaled so the turn lands on the middle of the exit edge. The centre
+              of the uMouse runs at the straight duty the whole way
+Inputs     :  curve to fill, turn angle (binary), sideways distance in mm, % of the
+              turn spent easing in and out
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void buildCurve(curveProfile *curve, uint32_t angle, uint16_t spanMM, uint8_t ramp)
+{
+	uint16_t shape[CURVE_POINTS];
+	uint16_t rampPoints = CURVE_POINTS*ramp/200;   //points easing in, the same again easing out
+	uint32_t sum = 0;
+	uint32_t done = 0;
+	int64_t side = 0;
+	int32_t s;
+	uint32_t heading;
+	uint64_t centreMM, offsetMM;               //both mm*256
+	
+	for(int i = 0;i<CURVE_POINTS;i++)
+	{
+		if(i<rampPoints)
+		{
+			s = sinQ15((uint32_t)(((uint64_t)(2*i+1)*QUARTER_TURN)/(2*rampPoints)));
+			shape[i] = (s*s)>>15;
+		}
+		else if(i>=CURVE_POINTS-rampPoints)
+		{
+			shape[i] = shape[CURVE_POINTS-1-i];
+		}
+		else
+		{
+			shape[i] = 32768;
+		}
+		sum += shape[i];
+	}
+	
+	//sideways travel of the shape with points one unit long, Q15
+	for(int i = 0;i<CURVE_POINTS;i++)
+	{
+		heading = ((uint64_t)angle*(2*done+shape[i]))/(2*sum);
+		side += sinQ15(heading);
+		done += shape[i];
+	}
+	
+	//the centre travels the scaled length, the wheels half the track either side of it
+	centreMM = ((uint64_t)spanMM*CURVE_POINTS*32768*256)/side;
+	offsetMM = ((uint64_t)angle*WHEEL_TRACK_MM*355*256/113)>>32;
+	//rounds the difference between the wheels on its own, it sets the angle turned
+	curve->outerSteps = ((centreMM+offsetMM)*ONE_SQUARE+CELL_MM*128)/(CELL_MM*256);
+	curve->innerSteps = curve->outerSteps-(2*offsetMM*ONE_SQUARE+CELL_MM*128)/(CELL_MM*256);
+	for(int i = 0;i<CURVE_POINTS;i++)
+	{
+		curve->spread[i] = ((offsetMM*CURVE_POINTS*shape[i]/sum)*32768)/centreMM;
+	}
+}
+
+/***********************************************************************************
+Function   :  setCurveDuty()
+Description:  sets the wheel duties for a point along a swept turn. The wheel with
+              more steps to go is on the outside
+Inputs     :  move, point along the turn
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void setCurveDuty(const movementVector &move, uint16_t point)
+{
+	movementVector duty = move;
+	uint32_t spread;
+	
+	if(point>=CURVE_POINTS)
+	{
+		point = CURVE_POINTS-1;
+	}
+	spread = move.curve->spread[point];
+	if(move.leftMotorSteps>move.rightMotorSteps)
+	{
+		duty.pwmL1 = move.pwmL1*(32768+spread)/32768;
+		duty.pwmR1 = move.pwmR1*(32768-spread)/32768;
+	}
+	else
+	{
+		duty.pwmL1 = move.pwmL1*(32768-spread)/32768;
+		duty.pwmR1 = move.pwmR1*(32768+spread)/32768;
+	}
+	setMotorMove(duty);
+}
+
+/***********************************************************************************
+Function   :  isGoalCell()
+Description:  checks if a cell is one of the goal cells
+Inputs     :  x, y
+Outputs    :  returns a 1 or 0
+
+Status     :  Complete
+***********************************************************************************/
+bool isGoalCell(int8_t x, int8_t y)
+{
+	for(uint8_t i = 0;i<GOAL_COUNT;i++)
+	{
+		if((goalCells[i][0] == x)&&(goalCells[i][1] == y))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/***********************************************************************************
+Function   :  wallIndex()
+Description:  where the wall on one side of a cell is kept in map::walls. The cells
+              either side of a wall share it
+Inputs     :  x, y, direction
+Outputs    :  wall number
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t wallIndex(int8_t x, int8_t y, uint8_t dir)
+{
+	if((dir&0x01) == 0)
+	{
+		return x*(MAP_SIZE+1)+y+((dir == NORTH) ? 1 : 0);
+	}
+	return WALL_ROWS+y*(MAP_SIZE+1)+x+((dir == WEST) ? 1 : 0);
+}
+
+/***********************************************************************************
+Function   :  wallState()
+Description:  the two bits kept for the wall on one side of a cell
+Inputs     :  x, y, direction
+Outputs    :  WALL_CLOSED, WALL_SEEN
+
+Status     :  Complete
+***********************************************************************************/
+uint8_t wallState(int8_t x, int8_t y, uint8_t dir)
+{
+	uint16_t wall = wallIndex(x,y,dir);
+	
+	return (MAP.walls[wall>>2]>>((wall&0x03)*2))&0x03;
+}
+
+/***********************************************************************************
+Function   :  cellWalls()
+Description:  the closed walls around a cell
+Inputs     :  x, y
+Outputs    :  bits   X,X,X,X,NORTH,EAST,SOUTH,WEST  wall=1
+
+Status     :  Complete
+***********************************************************************************/
+uint8_t cellWalls(int8_t x, int8_t y)
+{
+	uint8_t walls = 0;
+	
+	for(uint8_t d = 0;d<4;d++)
+	{
+		if((wallState(x,y,d)&WALL_CLOSED) != 0)
+		{
+			walls |= 0x08>>d;
+		}
+	}
+	return walls;
+}
+
+/***********************************************************************************
+Function   :  markWalls()
+Description:  records the sides of a cell that have been sensed. Sets the closed bits
+              straight, without going through voteWall()
+Inputs     :  x, y, sides seen and sides closed, bits as cellWalls()
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void markWalls(int8_t x, int8_t y, uint8_t seen, uint8_t walls)
+{
+	uint16_t wall;
+	
+	for(uint8_t d = 0;d<4;d++)
+	{
+		if((seen&(0x08>>d)) != 0)
+		{
+			wall = wallIndex(x,y,d);
+			MAP.walls[wall>>2] |= (WALL_SEEN|(((walls&(0x08>>d)) != 0) ? WALL_CLOSED : 0))<<((wall&0x03)*2);
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  voteWall()
+Description:  adds an observation to the confidence in a wall. The wall is closed
+              once the confidence reaches WALL_VOTE_CLOSE and only opened again when
+              it falls to WALL_VOTE_OPEN, so it doesn't flicker between the two. It
+              only counts as seen once the confidence has reached one or the other, so
+              a wall the readings are split on stays unknown and is sampled again
+Inputs     :  wall number, vote, positive for a wall
+Outputs    :  1 if a closed wall was taken out
+
+Status     :  Complete
+***********************************************************************************/
+bool voteWall(uint16_t wall, int8_t vote)
+{
+	int8_t votes = MAP.votes[wall]+vote;
+	
+	votes = (votes>WALL_VOTE_MAX) ? WALL_VOTE_MAX : (votes<-WALL_VOTE_MAX) ? -WALL_VOTE_MAX : votes;
+	MAP.votes[wall] = votes;
+	if(votes>=WALL_VOTE_CLOSE)
+	{
+		MAP.walls[wall>>2] |= (WALL_SEEN|WALL_CLOSED)<<((wall&0x03)*2);
+	}
+	else if(votes<=WALL_VOTE_OPEN)
+	{
+		MAP.walls[wall>>2] |= WALL_SEEN<<((wall&0x03)*2);
+		if((MAP.walls[wall>>2]>>((wall&0x03)*2))&WALL_CLOSED)
+		{
+			MAP.walls[wall>>2] &= ~(WALL_CLOSED<<((wall&0x03)*2));
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/***********************************************************************************
+Function   :  cellFlag()
+Description:  reads a cell's bit from map::scanned or map::pruned
+Inputs     :  flags, cell
+Outputs    :  returns a 1 or 0
+
+Status     :  Complete
+***********************************************************************************/
+bool cellFlag(const uint8_t *flags, uint16_t cell)
+{
+	return (flags[cell>>3]>>(cell&0x07))&0x01;
+}
+
+/***********************************************************************************
+Function   :  setCellFlag()
+Description:  sets a cell's bit in map::scanned or map::pruned
+Inputs     :  flags, cell
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void setCellFlag(uint8_t *flags, uint16_t cell)
+{
+	flags[cell>>3] |= 1<<(cell&0x07);
+}
+
+/***********************************************************************************
+Function   :  wallOpen()
+Description:  checks if the uMouse can move from a cell in a direction. A wall seen
+              from either side counts, and the edge of the maze is always closed.
+              A pruned cell can be left but not entered from outside its pocket
+Inputs     :  x, y, direction
+Outputs    :  returns a 1 or 0
+
+Status     :  Complete
+***********************************************************************************/
+bool wallOpen(int8_t x, int8_t y, uint8_t dir)
+{
+	int8_t nx = x+dirDX[dir];
+	int8_t ny = y+dirDY[dir];
+	
+	if((nx<0)||(nx>=MAP_SIZE)||(ny<0)||(ny>=MAP_SIZE))
+	{
+		return 0;
+	}
+	if((cellFlag(MAP.pruned,nx*MAP_SIZE+ny) == 1)&&(cellFlag(MAP.pruned,x*MAP_SIZE+y) == 0))
+	{
+		return 0;
+	}
+	return (wallState(x,y,dir)&WALL_CLOSED) == 0;
+}
+
+/***********************************************************************************
+Function   :  initDistField()
+Description:  floods the distance field out from every goal cell at once with the
+              walls known so far. Unknown walls are taken as open. The flood runs
+              backward, so a cell only gets a value through a move it can make
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void initDistField(void)
+{
+	uint16_t head = 0;
+	uint16_t tail = 0;
+	int8_t cx, cy, nx, ny;
+	
+	for(uint16_t cell = 0;cell<MAP_SIZE*MAP_SIZE;cell++)
+	{
+		MAP.fillVal[cell] = DIST_MAX;
+	}
+	for(uint8_t i = 0;i<GOAL_COUNT;i++)
+	{
+		MAP.fillVal[goalCells[i][0]*MAP_SIZE+goalCells[i][1]] = 0;
+		searchQueue[tail++] = goalCells[i][0]*MAP_SIZE+goalCells[i][1];
+	}
+	while(head != tail)
+	{
+		cx = searchQueue[head]/MAP_SIZE;
+		cy = searchQueue[head]%MAP_SIZE;
+		head++;
+		for(int d = 0;d<4;d++)
+		{
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			if((nx>=0)&&(nx<MAP_SIZE)&&(ny>=0)&&(ny<MAP_SIZE)&&
+			   wallOpen(nx,ny,(d+2)&0x03)&&(MAP.fillVal[nx*MAP_SIZE+ny] == DIST_MAX))
+			{
+				MAP.fillVal[nx*MAP_SIZE+ny] = MAP.fillVal[cx*MAP_SIZE+cy]+1;
+				searchQueue[tail++] = nx*MAP_SIZE+ny;
+			}
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  updateDistField()
+Description:  repairs the distance field after the walls of a cell changed. Only
+              cells whose value no longer matches their lowest open neighbour are
+              touched, working outward until the field is consistent again
+Inputs     :  x, y of the cell that changed
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void updateDistField(int8_t x, int8_t y)
+{
+	uint16_t head = 0;
+	uint16_t tail = 0;
+	uint16_t count = 0;
+	uint16_t lowest;
+	int8_t cx, cy, nx, ny;
+	
+	//the cell and everything around it may have lost a path
+	fieldQueued[x*MAP_SIZE+y] = 1;
+	searchQueue[tail++] = x*MAP_SIZE+y;
+	count++;
+	for(int d = 0;d<4;d++)
+	{
+		nx = x+dirDX[d];
+		ny = y+dirDY[d];
+		if((nx>=0)&&(nx<MAP_SIZE)&&(ny>=0)&&(ny<MAP_SIZE))
+		{
+			fieldQueued[nx*MAP_SIZE+ny] = 1;
+			searchQueue[tail++] = nx*MAP_SIZE+ny;
+			count++;
+		}
+	}
+	
+	//the queue wraps, a cell is never in it twice so it can't overflow
+	while(count != 0)
+	{
+		cx = searchQueue[head]/MAP_SIZE;
+		cy = searchQueue[head]%MAP_SIZE;
+		head = (head+1)%(MAP_SIZE*MAP_SIZE);
+		count--;
+		fieldQueued[cx*MAP_SIZE+cy] = 0;
+		if(isGoalCell(cx,cy))
+		{
+			continue;
+		}
+		
+		lowest = DIST_MAX;
+		for(int d = 0;d<4;d++)
+		{
+			if(wallOpen(cx,cy,d)&&(MAP.fillVal[(cx+dirDX[d])*MAP_SIZE+cy+dirDY[d]]+1<lowest))
+			{
+				lowest = MAP.fillVal[(cx+dirDX[d])*MAP_SIZE+cy+dirDY[d]]+1;
+			}
+		}
+		if(lowest == MAP.fillVal[cx*MAP_SIZE+cy])
+		{
+			continue;
+		}
+		
+		//the value changed, so the neighbours that can move here have to be checked again
+		MAP.fillVal[cx*MAP_SIZE+cy] = lowest;
+		for(int d = 0;d<4;d++)
+		{
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			if((nx>=0)&&(nx<MAP_SIZE)&&(ny>=0)&&(ny<MAP_SIZE)&&
+			   wallOpen(nx,ny,(d+2)&0x03)&&(fieldQueued[nx*MAP_SIZE+ny] == 0))
+			{
+				fieldQueued[nx*MAP_SIZE+ny] = 1;
+				searchQueue[tail] = nx*MAP_SIZE+ny;
+				tail = (tail+1)%(MAP_SIZE*MAP_SIZE);
+				count++;
+			}
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  pruneRegions()
+Description:  finds pockets that can't be on a shortest run and marks them pruned.
+              A pocket is a group of cells joined to the rest of the maze through a
+              single cell, with no goal cell in it. A run that went in would have to
+              come back out through that cell, so it can't be a shortest path. Dead
+              ends and dead end corridors are the simplest pockets. The search is a
+              depth first walk from the start with unknown walls taken as open, so
+              walls found later can only make a pocket more closed off. Pruning
+              leaves the distance field as it was, no shortest path went through
+              the pocket
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void pruneRegions(void)
+{
+	uint16_t top = 0;
+	uint16_t visits = 0;
+	uint16_t cell, child;
+	int8_t cx, cy, nx, ny;
+	uint8_t d;
+	
+	if(regionPruning == 0)
+	{
+		return;
+	}
+	memset(pruneOrder,0xFF,sizeof(pruneOrder));
+	
+	//searchQueue is the depth first stack and searchFrom the direction each cell was entered
+	cell = 0;
+	pruneOrder[cell] = visits;
+	pruneLow[cell] = visits;
+	pruneCell[visits++] = cell;
+	pruneNextDir[cell] = 0;
+	pruneGoal[cell] = isGoalCell(0,0);
+	searchFrom[cell] = 0xFF;
+	searchQueue[top++] = cell;
+	while(top != 0)
+	{
+		cell = searchQueue[top-1];
+		cx = cell/MAP_SIZE;
+		cy = cell%MAP_SIZE;
+		
+		//goes down the next open edge that isn't the one it came in on
+		d = pruneNextDir[cell];
+		if(d <= WEST)
+		{
+			pruneNextDir[cell]++;
+			if((wallOpen(cx,cy,d) == 0)||((searchFrom[cell] <= WEST)&&(d == ((searchFrom[cell]+2)&0x03))))
+			{
+				continue;
+			}
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			child = nx*MAP_SIZE+ny;
+			if(pruneOrder[child] != 0xFFFF)
+			{
+				if(pruneOrder[child]<pruneLow[cell])
+				{
+					pruneLow[cell] = pruneOrder[child];
+				}
+				continue;
+			}
+			pruneOrder[child] = visits;
+			pruneLow[child] = visits;
+			pruneCell[visits++] = child;
+			pruneNextDir[child] = 0;
+			pruneGoal[child] = isGoalCell(nx,ny);
+			searchFrom[child] = d;
+			searchQueue[top++] = child;
+			continue;
+		}
+		
+		//every edge is done, so the cells visited since this one are everything below it
+		top--;
+		if(top == 0)
+		{
+			break;
+		}
+		child = cell;
+		cell = searchQueue[top-1];
+		if((pruneLow[child]>=pruneOrder[cell])&&(pruneGoal[child] == 0))
+		{
+			for(uint16_t i = pruneOrder[child];i<visits;i++)
+			{
+				setCellFlag(MAP.pruned,pruneCell[i]);
+			}
+		}
+		if(pruneLow[child]<pruneLow[cell])
+		{
+			pruneLow[cell] = pruneLow[child];
+		}
+		pruneGoal[cell] |= pruneGoal[child];
+	}
+}
+
+/***********************************************************************************
+Function   :  bestFieldDir()
+Description:  picks the open neighbour with the lowest distance field value. Going
+              straight wins a tie
+Inputs     :  x, y, facing
+Outputs    :  direction, 0xFF if the cell can't reach the goal
+
+Status     :  Complete
+***********************************************************************************/
+uint8_t bestFieldDir(int8_t x, int8_t y, uint8_t facing)
+{
+	uint8_t best = 0xFF;
+	uint16_t lowest = DIST_MAX;
+	uint8_t d;
+	
+	for(int i = 0;i<4;i++)
+	{
+		d = (facing+i)&0x03;
+		if(wallOpen(x,y,d)&&(MAP.fillVal[(x+dirDX[d])*MAP_SIZE+y+dirDY[d]]<lowest))
+		{
+			lowest = MAP.fillVal[(x+dirDX[d])*MAP_SIZE+y+dirDY[d]];
+			best = d;
+		}
+	}
+	return best;
+}
+
+/***********************************************************************************
+Function   :  checkMapComplete()
+Description:  Checks to see if the current floodfill solution to the maze has all 
+              cells in the path mapped
+Inputs     :  None
+Outputs    :  returns a 1 or 0
+
+Status     :  Complete
+***********************************************************************************/
+int checkMapComplete(void)
+{
+	//the best path with unknown walls open is no shorter than the one already proven
+	return (knownPathLength() <= MAP.fillVal[0]) ? 1 : 0;
+}
+
+/***********************************************************************************
+Function   :  setMotorMove()
+Description:  Sets the PWMs up for the next movement. The control tick ramps the
+              wheels to the new duties at the profile's accel. The stop move brakes
+Inputs     :  move
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void setMotorMove(movementVector move)
+{
+	if(move.moveType == noMove)
+	{
+		setMotorMode(MOTOR_BRAKE);
+		return;
+	}
+	__disable_irq();
+	motorTargetR = ((int32_t)move.pwmR1-move.pwmR2)*256;
+	motorTargetL = ((int32_t)move.pwmL1-move.pwmL2)*256;
+	motorMode = MOTOR_DRIVE;
+	__enable_irq();
+}
+
+/***********************************************************************************
+Function   :  setMotorMode()
+Description:  brakes or coasts both motors from the next control tick, or drives
+              them at the last duties set
+Inputs     :  MOTOR_COAST, MOTOR_BRAKE or MOTOR_DRIVE
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void setMotorMode(uint8_t mode)
+{
+	__disable_irq();
+	if(mode != MOTOR_DRIVE)
+	{
+		motorTargetR = 0;
+		motorTargetL = 0;
+	}
+	motorMode = mode;
+	__enable_irq();
+}
+
+/***********************************************************************************
+Function   :  motorTick()
+Description:  steps the wheel duties toward their targets by at most the profile's
+              accel and writes the compare registers. They are preloaded, so the
+              new duties start on the next PWM period, and updates are held off
+              while the four are written so both wheels change on the same one
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void motorTick(void)
+{
+	int32_t step = profile->accel*256/CONTROL_RATE;
+#ifndef HOST_BUILD
+	uint32_t period = TIM1->ARR+1;
+	uint32_t full = PWM_PERIOD*256;
+#endif
+	
+	if(motorMode != MOTOR_DRIVE)
+	{
+		motorDutyR = 0;
+		motorDutyL = 0;
+	}
+	else
+	{
+		motorDutyR += (motorTargetR-motorDutyR>step) ? step : (motorDutyR-motorTargetR>step) ? -step :
+		              motorTargetR-motorDutyR;
+		motorDutyL += (motorTargetL-motorDutyL>step) ? step : (motorDutyL-motorTargetL>step) ? -step :
+		              motorTargetL-motorDutyL;
+	}
+	
+#ifndef HOST_BUILD
+	TIM1->CR1 |= TIM_CR1_UDIS;
+	if(motorMode == MOTOR_BRAKE)
+	{
+		TIM1->MOTOR_R1_CCR = period;
+		TIM1->MOTOR_R2_CCR = period;
+		TIM1->MOTOR_L1_CCR = period;
+		TIM1->MOTOR_L2_CCR = period;
+	}
+	else
+	{
+		TIM1->MOTOR_R1_CCR = (motorDutyR>0) ? (uint32_t)motorDutyR*period/full : 0;
+		TIM1->MOTOR_R2_CCR = (motorDutyR<0) ? (uint32_t)-motorDutyR*period/full : 0;
+		TIM1->MOTOR_L1_CCR = (motorDutyL>0) ? (uint32_t)motorDutyL*period/full : 0;
+		TIM1->MOTOR_L2_CCR = (motorDutyL<0) ? (uint32_t)-motorDutyL*period/full : 0;
+	}
+	TIM1->CR1 &= ~TIM_CR1_UDIS;
+#endif
+}
+
+/***********************************************************************************
+Function   :  genStartVector()
+Description:  generates the movement steps to get to position (0,0), ending up facing
+              the starting direction. The way home is run without sampling, so it only
+              goes through scanned cells, whose walls are all known
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void genStartVector(void)
+{
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	uint16_t steps = knownPath(currentXpos,currentYpos,0,0,path);
+	
+	if(steps == ASTAR_NONE)
+	{
+		return;
+	}
+	pushPathMoves(path,steps,direction);
+	pushTurnMove(defaultDir-((steps == 0) ? direction : path[steps-1]));
+}
+
+/***********************************************************************************
+Function   :  pushPathMoves()
+Description:  queues the moves that follow a path from the middle of one cell to the
+              middle of another. The uMouse turns in place if it has to, drives out
+              to the edge of its cell, then runs edge to edge without stopping. A
+              turn is a swept curve and two turns the same way in a row are one
+              U-turn through both cells. Cells in a straight line are one straight
+Inputs     :  directions of each step, number of steps, starting facing
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void pushPathMoves(const uint8_t *path, uint16_t steps, uint8_t facing)
+{
+	uint16_t i = 1;
+	uint16_t mm = CELL_MM/2;
+	uint8_t turn;
+	
+	if(steps == 0)
+	{
+		return;
+	}
+	
+	memset(opCarryMM,0,sizeof(opCarryMM));
+	pushTurnMove(path[0]-facing);
+	while(i<steps)
+	{
+		//cell i is entered heading path[i-1] and left heading path[i]
+		turn = (path[i]-path[i-1])&0x03;
+		if(turn == 0)
+		{
+			mm += CELL_MM;
+			i++;
+			continue;
+		}
+		pushStraightOps(mm,path[i-1]*2);
+		mm = 0;
+		if((i+1<steps)&&(((path[i+1]-path[i])&0x03) == turn))
+		{
+			pushOp(OP_TURN|OP_UTURN|((turn == 3) ? OP_LEFT : 0));
+			i += 2;
+			continue;
+		}
+		pushOp(OP_CURVE90|((turn == 3) ? OP_LEFT : 0));
+		i++;
+	}
+	pushStraightOps(mm+CELL_MM/2,path[steps-1]*2);
+}
+
+/***********************************************************************************
+Function   :  pushDiagonalMoves()
+Description:  queues a speed run that cuts staircases diagonally. The path is drawn
+              through the middle of every cell edge it crosses, a turning cell being
+              cut straight across its corner, and lines in the same direction are
+              joined. That leaves a 45 degree turn where a staircase starts or ends
+              and diagonal straights along it. Two turns with a single cut corner
+              between them are joined into one turn about where their outer lines
+              cross, giving 90 degree turns in one cell, 135 degree entries and exits
+              and U-turns. Each turn takes as much straight as it can from the lines
+              either side, up to the widest that keeps it in the path cells
+Inputs     :  directions of each step, number of steps, starting facing
+Outputs    :  1 if the moves were queued, 0 if a turn is too tight for the speed
+              profile or the path has more than RUN_SEGMENTS lines, and the run has
+              to be squares
+
+Status     :  Complete
+***********************************************************************************/
+bool pushDiagonalMoves(const uint8_t *path, uint16_t steps, uint8_t facing)
+{
+	uint16_t segs = 0;
+	uint16_t chords, mm, in, out;
+	uint8_t dir, turn;
+	int8_t a1, a2;
+	
+	if(steps == 0)
+	{
+		return 1;
+	}
+	
+	//the line out of every cell, the first and last run from the middle of the cell
+	for(int i = 0;i<=steps;i++)
+	{
+		if((i == 0)||(i == steps))
+		{
+			dir = path[(i == 0) ? 0 : steps-1]*2;
+			mm = CELL_MM/2;
+			chords = 0;
+		}
+		else
+		{
+			turn = (path[i]-path[i-1])&0x03;
+			dir = (path[i-1]*2+((turn == 1) ? 1 : (turn == 3) ? 7 : 0))&0x07;
+			mm = (turn == 0) ? CELL_MM : DIAG_MM;
+			chords = (turn == 0) ? 0 : 1;
+		}
+		if((segs != 0)&&(runSegDir[segs-1] == dir))
+		{
+			runSegLen[segs-1] += mm;
+			runSegChords[segs-1] += chords;
+			continue;
+		}
+		if(segs == RUN_SEGMENTS)
+		{
+			return 0;
+		}
+		runSegDir[segs] = dir;
+		runSegLen[segs] = mm;
+		runSegChords[segs] = chords;
+		runTurn[segs] = 0;
+		segs++;
+	}
+	
+	//joins turns that only have a single cut corner between them
+	for(int i = 0;i+1<segs;i++)
+	{
+		runTurn[i] = ((runSegDir[i+1]-runSegDir[i]+4)&0x07)-4;
+	}
+	for(int i = 0;i+2<segs;i++)
+	{
+		if((runSegChords[i+1] != 1)||(runSegLen[i+1] != DIAG_MM))
+		{
+			continue;
+		}
+		a1 = runTurn[i];
+		a2 = runTurn[i+1];
+		if((a1*a2<=0)||(abs(a1+a2)>3))
+		{
+			continue;
+		}
+		
+		//a 45, 90, 45 run is a U-turn from the edge before it to the edge after it
+		if((abs(a1) == 1)&&(abs(a2) == 2)&&(i+3<segs)&&(runSegChords[i+2] == 1)&&
+		   (runSegLen[i+2] == DIAG_MM)&&(runTurn[i+2] == a1))
+		{
+			runTurn[i] = (a1>0) ? RUN_UTURN : -RUN_UTURN;
+			runTurn[i+1] = 0;
+			runTurn[i+2] = 0;
+			runSegLen[i+1] = 0;
+			runSegLen[i+2] = 0;
+			continue;
+		}
+		
+		//the turn moves out to where the lines before and after it cross
+		if(abs(a1) == abs(a2))
+		{
+			runSegLen[i] += CELL_MM/2;
+			runSegLen[i+2] += CELL_MM/2;
+		}
+		else
+		{
+			runSegLen[i] += (abs(a2) == 2) ? CELL_MM : DIAG_MM;
+			runSegLen[i+2] += (abs(a2) == 2) ? DIAG_MM : CELL_MM;
+		}
+		runTurn[i] = a1+a2;
+		runTurn[i+1] = 0;
+		runSegLen[i+1] = 0;
+	}
+	
+	//shares out the straights, a turn takes what the one before it left, and half of the
+	//line after it unless it's the last line or a U-turn comes next
+	runCurveCount = 0;
+	in = runSegLen[0];
+	for(int i = 0;i+1<segs;i++)
+	{
+		runTurnMM[i] = 0;
+		runSegCurve[i] = 0;
+		
+		//the next line is the one after any joined away
+		out = i+1;
+		while((runSegLen[out] == 0)&&(out+1<segs))
+		{
+			out++;
+		}
+		if(runTurn[i] == 0)
+		{
+			continue;
+		}
+		if(abs(runTurn[i]) == RUN_UTURN)
+		{
+			//a U-turn runs edge to edge, so the line after it is all there
+			in = runSegLen[out];
+			continue;
+		}
+		mm = runSegLen[out];
+		for(int j = out;j+1<segs;j++)
+		{
+			if(runTurn[j] != 0)
+			{
+				if(abs(runTurn[j]) != RUN_UTURN)
+				{
+					mm /= 2;
+				}
+				break;
+			}
+		}
+		runTurnMM[i] = (in<mm) ? in : mm;
+		if(runTurnMM[i]>runTurnMaxMM[abs(runTurn[i])])
+		{
+			runTurnMM[i] = runTurnMaxMM[abs(runTurn[i])];
+		}
+		runTurnMM[i] -= runTurnMM[i]%MOVE_UNIT_MM;     //the turn op holds whole move units
+		runSegCurve[i] = runCurve((uint32_t)abs(runTurn[i])*EIGHTH_TURN,runTurnMM[i]);
+		if(runSegCurve[i] == 0)
+		{
+			return 0;
+		}
+		in = runSegLen[out]-runTurnMM[i];
+	}
+	
+	//each line, less what the turns either side of it take, after the turn into it
+	memset(opCarryMM,0,sizeof(opCarryMM));
+	pushTurnMove(path[0]-facing);
+	for(int i = 0;i<segs;i++)
+	{
+		if(runSegLen[i] == 0)
+		{
+			continue;
+		}
+		mm = runSegLen[i];
+		for(int j = i-1;j>=0;j--)
+		{
+			if(runTurn[j] == 0)
+			{
+				continue;
+			}
+			if(abs(runTurn[j]) == RUN_UTURN)
+			{
+				pushOp(OP_TURN|OP_UTURN|((runTurn[j]<0) ? OP_LEFT : 0));
+			}
+			else
+			{
+				pushOp(OP_TURN|((runTurn[j]<0) ? OP_LEFT : 0)|((abs(runTurn[j])-1)<<4)|(runTurnMM[j]/MOVE_UNIT_MM));
+				mm -= runTurnMM[j];
+			}
+			break;
+		}
+		for(int j = i;j+1<segs;j++)
+		{
+			if(runTurn[j] != 0)
+			{
+				mm -= runTurnMM[j];
+				break;
+			}
+		}
+		pushStraightOps(mm,runSegDir[i]);
+	}
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  runCurve()
+Description:  finds or builds the swept turn of a diagonal run. The turn is measured
+              by the straight it takes either side of where its lines cross. Easing
+              in and out tightens the middle of a turn, so a turn that comes out too
+              tight for the wheels is tried again with less easing
+Inputs     :  turn angle (binary), straight taken in mm
+Outputs    :  curve, 0 if it's out of room or too tight for the speed profile
+
+Status     :  Complete
+***********************************************************************************/
+const curveProfile *runCurve(uint32_t angle, uint16_t mm)
+{
+	curveProfile *curve;
+	uint16_t span;
+	int16_t ramp = profile->curveRamp;
+	bool tight = 1;
+	
+	for(uint8_t i = 0;i<runCurveCount;i++)
+	{
+		if((runCurveAngle[i] == angle)&&(runCurveMM[i] == mm))
+		{
+			return &runCurves[i];
+		}
+	}
+	if((runCurveCount == RUN_CURVES)||(mm == 0))
+	{
+		return 0;
+	}
+	
+	//how far the turn lands to the side of where it started
+	span = (angle == QUARTER_TURN) ? mm : mm*181/256;
+	curve = &runCurves[runCurveCount];
+	while((tight == 1)&&(ramp>=0))
+	{
+		buildCurve(curve,angle,span,ramp);
+		tight = 0;
+		for(int i = 0;i<CURVE_POINTS;i++)
+		{
+			tight |= (curve->spread[i]>CURVE_SPREAD_MAX);
+		}
+		ramp -= 20;
+	}
+	if(tight == 1)
+	{
+		return 0;
+	}
+	runCurveAngle[runCurveCount] = angle;
+	runCurveMM[runCurveCount] = mm;
+	runCurveCount++;
+	return curve;
+}
+
+/***********************************************************************************
+Function   :  pushStraightOps()
+Description:  queues a straight of any length as straight ops. Each straight is
+              rounded to whole move units, and what was rounded off is carried into
+              the next straight along the same line, either way along it, so the run
+              doesn't drift off across the maze
+Inputs     :  mm, heading in eighths of a turn
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void pushStraightOps(uint16_t mm, uint8_t heading)
+{
+	int16_t *carry = &opCarryMM[heading&0x03];
+	int16_t sign = ((heading&0x04) == 0) ? 1 : -1;
+	int16_t units = (mm+sign*(*carry)+MOVE_UNIT_MM/2)/MOVE_UNIT_MM;
+	
+	if(units<0)
+	{
+		units = 0;
+	}
+	*carry += sign*(mm-units*MOVE_UNIT_MM);
+	while(units>0)
+	{
+		pushOp((((heading&0x01) == 1) ? OP_DIAGONAL : OP_STRAIGHT)|((units<OP_LEN_MAX) ? units : OP_LEN_MAX));
+		units -= OP_LEN_MAX;
+	}
+}
+
+/***********************************************************************************
+Function   :  astarPath()
+Description:  A* search between two cells with the known walls, unknown walls are
+              taken as open. The Manhattan distance never overestimates in a grid
+              maze, so only cells that can be on a shortest path get expanded
+Inputs     :  start x, y, target x, y (ASTAR_GOAL for any goal cell), path buffer
+              of at least MAP_SIZE*MAP_SIZE directions
+Outputs    :  number of steps in the path, ASTAR_NONE if there is no path
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t astarPath(int8_t sx, int8_t sy, int8_t tx, int8_t ty, uint8_t *path)
+{
+	uint16_t cell = sx*MAP_SIZE+sy;
+	uint16_t next, g;
+	uint16_t f = astarH(sx,sy,tx,ty);
+	int8_t cx, cy, nx, ny;
+	
+	memset(astarState,0,sizeof(astarState));
+	memset(astarBucket,0xFF,sizeof(astarBucket));
+	astarExpanded = 0;
+	
+	astarG[cell] = 0;
+	astarState[cell] = 1;
+	astarInsert(cell,f);
+	
+	while(1)
+	{
+		//the heuristic is consistent, so the lowest f never goes down
+		while((f<ASTAR_BUCKETS)&&(astarBucket[f] == ASTAR_NONE))
+		{
+			f++;
+		}
+		if(f == ASTAR_BUCKETS)
+		{
+			return ASTAR_NONE;
+		}
+		cell = astarBucket[f];
+		astarRemove(cell,f);
+		astarState[cell] = 2;
+		astarExpanded++;
+		
+		cx = cell/MAP_SIZE;
+		cy = cell%MAP_SIZE;
+		if(((tx == ASTAR_GOAL)&&isGoalCell(cx,cy))||((cx == tx)&&(cy == ty)))
+		{
+			break;
+		}
+		
+		for(int d = 0;d<4;d++)
+		{
+			if(wallOpen(cx,cy,d) == 0)
+			{
+				continue;
+			}
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			next = nx*MAP_SIZE+ny;
+			g = astarG[cell]+1;
+			if((astarState[next] == 2)||((astarState[next] == 1)&&(g>=astarG[next])))
+			{
+				continue;
+			}
+			if(astarState[next] == 1)
+			{
+				astarRemove(next,astarG[next]+astarH(nx,ny,tx,ty));
+			}
+			astarG[next] = g;
+			astarState[next] = 1;
+			searchFrom[next] = d;
+			astarInsert(next,g+astarH(nx,ny,tx,ty));
+		}
+	}
+	
+	//walks back from the target filling in the path from the end
+	g = astarG[cell];
+	for(int i = g-1;i>=0;i--)
+	{
+		path[i] = searchFrom[cell];
+		cell -= dirDX[path[i]]*MAP_SIZE+dirDY[path[i]];
+	}
+	return g;
+}
+
+/***********************************************************************************
+Function   :  astarH()
+Description:  A* heuristic, the Manhattan distance to the target. For the goal it is
+              the distance to the closest goal cell
+Inputs     :  x, y, target x, y
+Outputs    :  estimated steps
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t astarH(int8_t x, int8_t y, int8_t tx, int8_t ty)
+{
+	uint16_t h, best;
+	
+	if(tx != ASTAR_GOAL)
+	{
+		return abs(x-tx)+abs(y-ty);
+	}
+	best = DIST_MAX;
+	for(uint8_t i = 0;i<GOAL_COUNT;i++)
+	{
+		h = abs(x-goalCells[i][0])+abs(y-goalCells[i][1]);
+		if(h<best)
+		{
+			best = h;
+		}
+	}
+	return best;
+}
+
+/***********************************************************************************
+Function   :  astarInsert()
+Description:  adds a cell to the front of an open list bucket. Newest first breaks
+              f ties toward the deeper cell
+Inputs     :  cell index, f
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void astarInsert(uint16_t cell, uint16_t f)
+{
+	astarPrev[cell] = ASTAR_NONE;
+	astarNext[cell] = astarBucket[f];
+	if(astarBucket[f] != ASTAR_NONE)
+	{
+		astarPrev[astarBucket[f]] = cell;
+	}
+	astarBucket[f] = cell;
+}
+
+/***********************************************************************************
+Function   :  astarRemove()
+Description:  unlinks a cell from its open list bucket
+Inputs     :  cell index, f
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void astarRemove(uint16_t cell, uint16_t f)
+{
+	if(astarPrev[cell] == ASTAR_NONE)
+	{
+		astarBucket[f] = astarNext[cell];
+	}
+	else
+	{
+		astarNext[astarPrev[cell]] = astarNext[cell];
+	}
+	if(astarNext[cell] != ASTAR_NONE)
+	{
+		astarPrev[astarNext[cell]] = astarPrev[cell];
+	}
+}
+
+/***********************************************************************************
+Function   :  genRunVector()
+Description:  generates the move program of the solution to the maze along the
+              shortest path through scanned cells, so the speed run never drives
+              through a wall it hasn't seen
+Inputs     :  None
+Outputs    :  1 if the program was queued, 0 if no such path is known yet
+
+Status     :  Complete
+***********************************************************************************/
+bool genRunVector(void)
+{
+	uint8_t path[MAP_SIZE*MAP_SIZE] = {};     //knownPath() only writes the steps it finds
+	uint16_t steps;
+	
+	clearMoves();
+	steps = knownPath(0,0,ASTAR_GOAL,0,path);
+	if(steps == ASTAR_NONE)
+	{
+		return 0;
+	}
+	if((diagonalRuns == 0)||(pushDiagonalMoves(path,steps,defaultDir) == 0))
+	{
+		pushPathMoves(path,steps,defaultDir);
+	}
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  knownPath()
+Description:  the shortest path between two cells through scanned cells, whose walls
+              are all known. It is walked back from the target down the flood from
+              the start, keeping on in the same direction wherever a tie allows, so
+              the path has as few turns as its length lets it
+Inputs     :  start x, y, target x, y (ASTAR_GOAL for the nearest goal cell), path
+              buffer of at least MAP_SIZE*MAP_SIZE directions
+Outputs    :  number of steps in the path, ASTAR_NONE if there is no such path
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t knownPath(int8_t sx, int8_t sy, int8_t tx, int8_t ty, uint8_t *path)
+{
+	uint16_t steps = DIST_MAX;
+	int8_t x = tx;
+	int8_t y = ty;
+	int8_t px, py;
+	uint8_t next = NORTH;
+	uint8_t d = NORTH;
+	
+	floodDist(sx,sy,fromHere,1);
+	if(tx == ASTAR_GOAL)
+	{
+		for(uint8_t i = 0;i<GOAL_COUNT;i++)
+		{
+			if(fromHere[goalCells[i][0]*MAP_SIZE+goalCells[i][1]]<steps)
+			{
+				x = goalCells[i][0];
+				y = goalCells[i][1];
+				steps = fromHere[x*MAP_SIZE+y];
+			}
+		}
+	}
+	else
+	{
+		steps = fromHere[x*MAP_SIZE+y];
+	}
+	if(steps >= DIST_MAX)
+	{
+		return ASTAR_NONE;
+	}
+	
+	for(uint16_t i = steps;i>0;i--)
+	{
+		//the step into this cell, trying the direction of the one out of it first
+		px = x;
+		py = y;
+		for(uint8_t j = 0;j<4;j++)
+		{
+			d = (next+j)&0x03;
+			px = x-dirDX[d];
+			py = y-dirDY[d];
+			if((px>=0)&&(px<MAP_SIZE)&&(py>=0)&&(py<MAP_SIZE)&&
+			   (fromHere[px*MAP_SIZE+py] == i-1)&&wallOpen(px,py,d))
+			{
+				break;
+			}
+		}
+		path[i-1] = d;
+		x = px;
+		y = py;
+		next = d;
+	}
+	return steps;
+}
+
+/***********************************************************************************
+Function   :  initPose()
+Description:  places the pose estimate in the middle of the current cell, facing the
+              current direction
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void initPose(void)
+{
+	__disable_irq();
+	pose.x = (currentXpos*CELL_MM+CELL_MM/2)*256;
+	pose.y = (currentYpos*CELL_MM+CELL_MM/2)*256;
+	pose.theta = (uint32_t)direction<<30;
+	lastEnPosRight = enPosRight;
+	lastEnPosLeft = enPosLeft;
+	leftWallSeen = 0;
+	rightWallSeen = 0;
+	__enable_irq();
+}
+
+/***********************************************************************************
+Function   :  getPose()
+Description:  copies the pose estimate without the control tick changing it halfway
+Inputs     :  where to copy it to
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void getPose(poseEstimate *now)
+{
+	__disable_irq();
+	*now = pose;
+	__enable_irq();
+}
+
+/***********************************************************************************
+Function   :  setPosFromPose()
+Description:  Sets the uMouse's cell and direction from the pose estimate. The
+              direction is the nearest of the four headings
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void setPosFromPose(void)
+{
+	poseEstimate now;
+	int8_t x, y;
+	
+	getPose(&now);
+	x = poseToCell(now.x);
+	y = poseToCell(now.y);
+	if((x>=0)&&(y>=0))
+	{
+		currentXpos = x;
+		currentYpos = y;
+	}
+	direction = ((now.theta+0x20000000)>>30)&0x03;
+}
+
+/***********************************************************************************
+Function   :  poseToCell()
+Description:  converts a pose coordinate to a cell index
+Inputs     :  coordinate in mm*256
+Outputs    :  cell index, -1 if outside of the maze
+
+Status     :  Complete
+***********************************************************************************/
+int8_t poseToCell(int32_t coord)
+{
+	if((coord<0)||(coord>=MAP_SIZE*CELL_MM*256))
+	{
+		return -1;
+	}
+	return coord/(CELL_MM*256);
+}
+
+/***********************************************************************************
+Function   :  updatePose()
+Description:  integrates the encoder steps since the last tick into the pose,
+              using the heading halfway through the tick
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void updatePose(void)
+{
+	int32_t right = enPosRight;
+	int32_t left = enPosLeft;
+	int32_t dRight = right-lastEnPosRight;
+	int32_t dLeft = left-lastEnPosLeft;
+	int32_t dist, dTheta;
+	uint32_t midTheta;
+	
+	lastEnPosRight = right;
+	lastEnPosLeft = left;
+	
+	dist = (dRight+dLeft)*STEP_MM_Q8/2;
+	dTheta = (dLeft-dRight)*ANGLE_PER_STEP;
+	midTheta = pose.theta+dTheta/2;
+	
+	//EAST is toward smaller x
+	pose.x -= (dist*sinQ15(midTheta))>>15;
+	pose.y += (dist*sinQ15(midTheta+0x40000000))>>15;
+	pose.theta += dTheta;
+}
+
+/***********************************************************************************
+Function   :  updateWheelSpeeds()
+Description:  works out both wheel speeds for this tick
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void updateWheelSpeeds(void)
+{
+	wheelSpeed(&speedRight,enCountRight,enPosRight);
+	wheelSpeed(&speedLeft,enCountLeft,enPosLeft);
+}
+
+/***********************************************************************************
+Function   :  wheelSpeed()
+Description:  speed of one wheel. At low speed a tick sees few edges, so it comes
+              from the time over the last four, a whole quadrature cycle, which
+              cancels the channels not being exactly a quarter cycle apart. Until
+              the next edge comes the wheel can't be going any faster than if it
+              came now, so a slowing wheel reads down to a stop. As the edges over
+              the last SPEED_COUNT_TICKS go up to SPEED_BLEND_EDGES, edge counting
+              takes over, which late edge interrupts don't throw off. It comes in
+              with the square of the edges, as a count of a few is too coarse
+Inputs     :  wheel, edge count and quadrature position, taken before the time
+Outputs    :  edges per second*256, forward positive
+
+Status     :  Complete
+***********************************************************************************/
+int32_t wheelSpeed(wheelTimer *wheel, uint32_t count, int32_t pos)
+{
+	uint32_t now = TIM2->CNT;
+	uint32_t newest = wheel->edgeTime[count&(EDGE_TIMES-1)];
+	uint32_t cycle = newest-wheel->edgeTime[(count-4)&(EDGE_TIMES-1)];
+	uint32_t open = now-wheel->edgeTime[(count-3)&(EDGE_TIMES-1)];
+	uint32_t edges = count-wheel->tickCount[wheel->tick];
+	uint32_t weight = (edges<SPEED_BLEND_EDGES) ? edges*edges/SPEED_BLEND_EDGES : SPEED_BLEND_EDGES;
+	uint32_t periodSpeed = 0;
+	uint32_t countSpeed = edges*CONTROL_RATE*256/SPEED_COUNT_TICKS;
+	
+	wheel->tickCount[wheel->tick] = count;
+	wheel->tick = (wheel->tick+1)&(SPEED_COUNT_TICKS-1);
+	if(pos != wheel->lastPos)
+	{
+		wheel->sign = (pos-wheel->lastPos>0) ? 1 : -1;
+	}
+	wheel->lastPos = pos;
+	
+	if(now-newest>=SPEED_STOP_US)
+	{
+		wheel->speed = 0;
+		return 0;
+	}
+	//the first cycle after a stop counts from the last edge before it
+	if((cycle == 0)||(cycle>=SPEED_STOP_US))
+	{
+		weight = SPEED_BLEND_EDGES;
+	}
+	else
+	{
+		periodSpeed = 4*EDGE_TIMER_HZ*256/((open>cycle) ? open : cycle);
+	}
+	wheel->speed = wheel->sign*(int32_t)(((uint64_t)periodSpeed*(SPEED_BLEND_EDGES-weight)+
+	                                     (uint64_t)countSpeed*weight)/SPEED_BLEND_EDGES);
+	return wheel->speed;
+}
+
+/***********************************************************************************
+Function   :  wallEdgeCorrect()
+Description:  when a side sensor loses its wall the sensor has just passed a cell
+              edge, which fixes the uMouse's position along the direction of travel.
+              Only used while driving close to one of the four headings
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete, EDGE_OFFSET_MM needs to be measured on the uMouse
+***********************************************************************************/
+void wallEdgeCorrect(void)
+{
+	//this tick's readings, sampleWalls() has just taken them
+	bool leftWall = wallHistory[0]&0x01;
+	bool rightWall = wallHistory[2]&0x01;
+	uint8_t heading = ((pose.theta+0x20000000)>>30)&0x03;
+	int32_t headingErr = (int32_t)(pose.theta-((uint32_t)heading<<30));
+	int32_t *along;
+	int32_t sign, travel, edge;
+	
+	if(((leftWallSeen&&!leftWall)||(rightWallSeen&&!rightWall))&&
+	   (headingErr<EDGE_MAX_ANGLE)&&(headingErr>-EDGE_MAX_ANGLE))
+	{
+		along = ((heading==NORTH)||(heading==SOUTH)) ? &pose.y : &pose.x;
+		sign = ((heading==NORTH)||(heading==WEST)) ? 1 : -1;
+		
+		//distance travelled along the heading, kept positive so the rounding is simple
+		travel = sign*(*along)+(EDGE_OFFSET_MM+MAP_SIZE*CELL_MM)*256;
+		edge = ((travel+CELL_MM*128)/(CELL_MM*256))*(CELL_MM*256);
+		if((travel-edge<EDGE_WINDOW_MM*256)&&(edge-travel<EDGE_WINDOW_MM*256))
+		{
+			*along = sign*(edge-(EDGE_OFFSET_MM+MAP_SIZE*CELL_MM)*256);
+		}
+	}
+	leftWallSeen = leftWall;
+	rightWallSeen = rightWall;
+}
+
+/***********************************************************************************
+Function   :  sampleWalls()
+Description:  shifts this tick's wall readings into the history mapCellAt() votes from.
+              The sensor distances are taken as four 16 bit lanes of one word, the
+              uMouse and the PC both being little endian, and compared with their
+              wall distances in one subtract. Every distance is below the lane's top
+              bit, so no lane borrows from the next, and a lane keeps its top bit only
+              if its distance is within its wall distance
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void sampleWalls(void)
+{
+	uint64_t lanes;
+	uint64_t within;
+	
+	memcpy(&lanes,&wallDist,sizeof(lanes));
+	within = ((wallLimits|WALL_LANE_GUARDS)-lanes)&WALL_LANE_GUARDS;
+	wallHistory[0] = (wallHistory[0]<<1)|(uint8_t)(within>>63);
+	wallHistory[1] = (wallHistory[1]<<1)|((uint8_t)(within>>47)&0x01);
+	wallHistory[2] = (wallHistory[2]<<1)|((uint8_t)(within>>31)&0x01);
+}
+
+/***********************************************************************************
+Function   :  sinQ15()
+Description:  sine of a binary angle from the quarter wave table, linearly
+              interpolated
+Inputs     :  angle, 2^32 is one turn
+Outputs    :  sin in Q15
+
+Status     :  Complete
+***********************************************************************************/
+int32_t sinQ15(uint32_t angle)
+{
+	uint32_t index = (angle>>24)&0x3F;
+	int32_t frac = (angle>>16)&0xFF;
+	int32_t value;
+	
+	//second and fourth quarters run the table backwards
+	if(angle&0x40000000)
+	{
+		index = 64-index;
+		value = sinTable[index]+(((sinTable[index-1]-sinTable[index])*frac)>>8);
+	}
+	else
+	{
+		value = sinTable[index]+(((sinTable[index+1]-sinTable[index])*frac)>>8);
+	}
+	return (angle&0x80000000) ? -value : value;
+}
+
+/***********************************************************************************
+Function   :  controlTick()
+Description:  runs every control loop tick from the TIM6 interrupt
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete for the odometry, motor control still to come
+***********************************************************************************/
+void controlTick(void)
+{
+	//the edge counts the main loop has seen so far, for the input log
+	uint32_t right = enCountRight;
+	uint32_t left = enCountLeft;
+	
+	//first, so the duties land the same time after every tick
+	motorTick();
+	updatePose();
+	updateWheelSpeeds();
+	analogRead();
+	irLinearize();
+	sampleWalls();
+	wallEdgeCorrect();
+	moveTick(right,left);
+	logTick(right,left);
+}
+
+/***********************************************************************************
+Function   :  resetEnCount()
+Description:  resets the encoder count. The edge counters keep running for the input
+              log, a move counts from where they were when it started
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void resetEnCounts()
+{
+	enBaseRight = enCountRight;
+	enBaseLeft = enCountLeft;
+}
+
+/***********************************************************************************
+Function   :  cpuTick()
+Description:  times the control tick that has just run against when it was due, and
+              once a second takes the EXTI rates and the idle time. A tick starting
+              early means the schedule was set from a late one, or TIM2 restarted
+              on a clock change, so the schedule is set from it instead
+Inputs     :  TIM2 time the tick started
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void cpuTick(uint32_t start)
+{
+	uint32_t end = TIM2->CNT;
+	int32_t late = (int32_t)(start-tickDue);
+	uint32_t skipped = 0;
+	uint32_t idle = idleUs;
+	cpuLoad *load;
+	
+	if(late<0)
+	{
+		tickDue = start;
+		late = 0;
+	}
+	//a tick that runs a whole period late has taken the place of one that never ran
+	skipped = late/TICK_US;
+	tickDue += skipped*TICK_US;
+	late -= skipped*TICK_US;
+	
+	for(uint8_t i = 0;i<1+cpuRunning;i++)
+	{
+		load = (i == 0) ? &cpuGather : &cpuRun;
+		load->ticks++;
+		load->execSum += end-start;
+		load->execMax = (end-start>load->execMax) ? end-start : load->execMax;
+		load->lateMax = (late>load->lateMax) ? late : load->lateMax;
+		load->missed += skipped+(end-tickDue>TICK_US);
+	}
+	tickDue += TICK_US;
+	
+	if(cpuGather.ticks>=CONTROL_RATE)
+	{
+		for(uint8_t i = 0;i<EXTI_LINES;i++)
+		{
+			cpuGather.extiRate[i] = extiCount[i]-extiLast[i];
+			extiLast[i] += cpuGather.extiRate[i];
+			if((cpuRunning == 1)&&(cpuGather.extiRate[i]>cpuRun.extiRate[i]))
+			{
+				cpuRun.extiRate[i] = cpuGather.extiRate[i];
+			}
+		}
+		cpuGather.idlePercent = ((idle-idleLast)<cpuGather.ticks*TICK_US) ?
+		                        (idle-idleLast)*100/(cpuGather.ticks*TICK_US) : 100;
+		idleLast = idle;
+		if((cpuRunning == 1)&&(cpuGather.idlePercent<cpuRun.idlePercent))
+		{
+			cpuRun.idlePercent = cpuGather.idlePercent;
+		}
+		cpuSecond = cpuGather;
+		memset(&cpuGather,0,sizeof(cpuGather));
+	}
+}
+
+/***********************************************************************************
+Function   :  cpuIdle()
+Description:  the idle counter, called on every pass of the move loop and of
+              HAL_Delay(), which every other wait that isn't a stopFor() goes
+              through. Time since the last pass is idle unless the pass took longer
+              than CPU_IDLE_GAP_US, when an interrupt or the main loop had work to
+              do. Interrupts shorter than that, a single encoder edge, are counted
+              as idle. Time in Stop 2 is in neither the idle time nor the ticks it's
+              taken over, since TIM2 and the tick both stand
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void cpuIdle(void)
+{
+	uint32_t now = TIM2->CNT;
+	
+	if(now-idleSeen<=CPU_IDLE_GAP_US)
+	{
+		idleUs += now-idleSeen;
+	}
+	idleSeen = now;
+}
+
+#ifndef HOST_BUILD
+/***********************************************************************************
+Function   :  HAL_Delay()
+Description:  replaces HAL's weak wait with one that counts as idle. Like HAL's it
+              waits a ms more than asked, so it's never short
+Inputs     :  ms to wait, HAL_MAX_DELAY for ever
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+extern "C" void HAL_Delay(uint32_t delay)
+{
+	uint32_t start = HAL_GetTick();
+	
+	while(HAL_GetTick()-start<=delay)
+	{
+		cpuIdle();
+	}
+}
+#endif
+
+/***********************************************************************************
+Function   :  cpuRunStart()
+Description:  clears the run figures and starts a new second with the program, so
+              the time spent setting it up isn't in its first second
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void cpuRunStart(void)
+{
+	__disable_irq();
+	memset(&cpuGather,0,sizeof(cpuGather));
+	memset(&cpuRun,0,sizeof(cpuRun));
+	cpuRun.idlePercent = 100;
+	for(uint8_t i = 0;i<EXTI_LINES;i++)
+	{
+		extiLast[i] = extiCount[i];
+	}
+	idleLast = idleUs;
+	cpuRunning = 1;
+	__enable_irq();
+}
+
+/***********************************************************************************
+Function   :  cpuRunEnd()
+Description:  keeps the run figures as the summary of the program. A program shorter
+              than a second only has the tick figures
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void cpuRunEnd(void)
+{
+	__disable_irq();
+	cpuRunning = 0;
+	cpuLastRun = cpuRun;
+	__enable_irq();
+}
+
+#ifndef HOST_BUILD
+/***********************************************************************************
+Function   :  SystemClock_Config()
+Description:  Configures the Base Clock that all other periferals use
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Probably works? Auto-generated code
+***********************************************************************************/
+void SystemClock_Config(void)
+{
+
+  RCC_OscInitTypeDef RCC_OscInitStruct;
+  RCC_ClkInitTypeDef RCC_ClkInitStruct;
+  RCC_PeriphCLKInitTypeDef PeriphClkInit;
+
+    /**Initializes the CPU, AHB and APB busses clocks 
+    */
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+  RCC_OscInitStruct.MSIState = RCC_MSI_ON;
+  RCC_OscInitStruct.MSICalibrationValue = 0;
+  RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_6;
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+  HAL_RCC_OscConfig(&RCC_OscInitStruct);
+
+    /**Initializes the CPU, AHB and APB busses clocks 
+    */
+  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
+                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+
+  HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0);
+
+  PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_ADC;
+  PeriphClkInit.AdcClockSelection = RCC_ADCCLKSOURCE_PLLSAI1;
+  PeriphClkInit.PLLSAI1.PLLSAI1Source = RCC_PLLSOURCE_MSI;
+  PeriphClkInit.PLLSAI1.PLLSAI1M = 1;
+  PeriphClkInit.PLLSAI1.PLLSAI1N = 16;
+  PeriphClkInit.PLLSAI1.PLLSAI1P = RCC_PLLP_DIV7;
+  PeriphClkInit.PLLSAI1.PLLSAI1Q = RCC_PLLQ_DIV2;
+  PeriphClkInit.PLLSAI1.PLLSAI1R = RCC_PLLR_DIV8;     //8 MHz, the ADC halves it to the 4 MHz it was tuned at
+  PeriphClkInit.PLLSAI1.PLLSAI1ClockOut = RCC_PLLSAI1_ADC1CLK;
+  HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit);
+
+    /**Configure the main internal regulator output voltage 
+    */
+  HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1);
+
+    /**Configure the Systick interrupt time 
+    */
+  HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq()/1000);
+
+    /**Configure the Systick 
+    */
+  HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK);
+
+  /* SysTick_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0);
+}
+
+/***********************************************************************************
+Function   :  setClockProfile()
+Description:  switches the system clock between MSI at 4 MHz and the main PLL at
+              80 MHz, with the flash wait states, prefetch and caches to suit. MSI
+              stays on at 4 MHz as the source of both PLLs. SysTick, the TIM1 PWM
+              and the TIM6 control tick are rescaled so their rates don't change,
+              TIM1 by its period since motorTick() scales the duties to it. The
+              ADC runs off PLLSAI1 and doesn't see the switch. The timers load the
+              new values on their next update, so the PWM period and the tick in
+              progress keep the old rate. Switch with the motors stopped
+Inputs     :  CLOCK_IDLE or CLOCK_RUN
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void setClockProfile(uint8_t clock)
+{
+	RCC_OscInitTypeDef RCC_OscInitStruct = {};
+	RCC_ClkInitTypeDef RCC_ClkInitStruct = {};
+	uint32_t count;
+	
+	if(clock == clockProfile)
+	{
+		return;
+	}
+	
+	//the APB dividers stay at 1, so the timers are clocked at the PCLK rates
+	RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK|RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+	RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+	RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+	if(clock == CLOCK_RUN)
+	{
+		//4 MHz*40/2, four wait states at voltage range 1
+		RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+		RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_MSI;
+		RCC_OscInitStruct.PLL.PLLM = 1;
+		RCC_OscInitStruct.PLL.PLLN = 40;
+		RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV7;
+		RCC_OscInitStruct.PLL.PLLQ = RCC_PLLQ_DIV2;
+		RCC_OscInitStruct.PLL.PLLR = RCC_PLLR_DIV2;
+		if(HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+		{
+			while(1){}
+		}
+		RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+		if(HAL_RCC_ClockConfig(&RCC_ClkInitStruct,FLASH_LATENCY_4) != HAL_OK)
+		{
+			while(1){}
+		}
+		__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+	}
+	else
+	{
+		//off the PLL before it can be stopped
+		__HAL_FLASH_PREFETCH_BUFFER_DISABLE();
+		RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+		if(HAL_RCC_ClockConfig(&RCC_ClkInitStruct,FLASH_LATENCY_0) != HAL_OK)
+		{
+			while(1){}
+		}
+		RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+		if(HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+		{
+			while(1){}
+		}
+	}
+	__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+	__HAL_FLASH_DATA_CACHE_ENABLE();
+	clockProfile = clock;
+	
+	HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq()/1000);
+	__HAL_TIM_SET_AUTORELOAD(&htim1,(HAL_RCC_GetPCLK2Freq()/PWM_FREQ_HZ)-1);
+	__HAL_TIM_SET_PRESCALER(&htim6,(HAL_RCC_GetPCLK1Freq()/1000000)-1);
+	
+	//TIM2 only wraps every 71 minutes, so a new prescaler is loaded straight away. The
+	//update event clears the count, which is put back so wheelSpeed() and cpuTick()
+	//keep their timebase
+	if(TIM2->PSC != (HAL_RCC_GetPCLK1Freq()/EDGE_TIMER_HZ)-1)
+	{
+		count = TIM2->CNT;
+		__HAL_TIM_SET_PRESCALER(&htim2,(HAL_RCC_GetPCLK1Freq()/EDGE_TIMER_HZ)-1);
+		TIM2->EGR = TIM_EGR_UG;
+		TIM2->CNT = count;
+	}
+}
+
+/***********************************************************************************
+Function   :  stopFor()
+Description:  stops the core in Stop 2 rather than spinning while the uMouse waits.
+              LPTIM1 runs on off LSI and wakes it once ms have gone by, and any other
+              interrupt, the button, a mode switch or an encoder edge, wakes it too.
+              A timed stop ends early if the mode switches change, so the mode loops
+              see it at once. The motors are left coasting, since TIM1 holds its
+              outputs while it stands. Stop 2 wakes on MSI, so the clock is switched
+              to it first and put back after.
+              Interrupts are held off over each stop so PLLSAI1 is running for the
+              ADC again before anything can use it, and SysTick, which stands still,
+              is moved on by the time LPTIM1 counted. Wakes for anything else go
+              straight back into Stop 2. A debugger loses the core while it is
+              stopped unless the build defines DEBUG, as the IDE's debug builds do,
+              which keeps the debug clocks running through Stop 2
+Inputs     :  ms to stop for, up to 65 s. 0 stops until the button is pressed
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+void stopFor(uint16_t ms)
+{
+	uint8_t clock = clockProfile;
+	uint32_t switches = GPIOB->IDR&0xC0;
+	uint16_t start;
+	uint16_t before;
+	
+	//a control tick writes the coast and the next PWM period loads it
+	setMotorMode(MOTOR_COAST);
+	HAL_Delay(1);
+	setClockProfile(CLOCK_IDLE);
+	
+	start = lptimNow();
+	if(ms != 0)
+	{
+		//the compare has to stay below the reload
+		__HAL_LPTIM_CLEAR_FLAG(&hlptim1,LPTIM_FLAG_CMPOK);
+		__HAL_LPTIM_COMPARE_SET(&hlptim1,(uint16_t)(start+ms)%0xFFFF);
+		while(__HAL_LPTIM_GET_FLAG(&hlptim1,LPTIM_FLAG_CMPOK) == 0){}
+	}
+	do
+	{
+		__disable_irq();
+		before = lptimNow();
+		HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+		__HAL_RCC_PLLSAI1_ENABLE();
+		while(__HAL_RCC_GET_FLAG(RCC_FLAG_PLLSAI1RDY) == 0){}
+		uwTick += (uint16_t)(lptimNow()-before);
+		__enable_irq();
+	}
+	while((ms != 0) ? (((uint16_t)(lptimNow()-start)<ms)&&((GPIOB->IDR&0xC0) == switches)) :
+	                  ((GPIOA->IDR&0x1000) == 0x0000));
+	
+	setClockProfile(clock);
+}
+
+/***********************************************************************************
+Function   :  lptimNow()
+Description:  LPTIM1 count. It is clocked apart from the core, so it is read until
+              two reads agree
+Inputs     :  None
+Outputs    :  ms, wrapping at 16 bits
+
+Status     :  Complete
+***********************************************************************************/
+uint16_t lptimNow(void)
+{
+	uint32_t count;
+	
+	do
+	{
+		count = LPTIM1->CNT;
+	}
+	while(count != LPTIM1->CNT);
+	return count;
+}
+
+/***********************************************************************************
+Function   :  benchPlanners()
+Description:  times the planners on each clock profile with the DWT cycle counter
+              and leaves the averages in plannerUs. The map is the saved run's if
+              there is one, otherwise the open maze
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void benchPlanners(void)
+{
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	uint32_t cycles[5];
+	uint32_t start;
+	
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	loadRun();
+	
+	for(uint8_t clock = 0;clock<CLOCK_PROFILES;clock++)
+	{
+		setClockProfile(clock);
+		memset(cycles,0,sizeof(cycles));
+		for(uint8_t i = 0;i<BENCH_REPEATS;i++)
+		{
+			start = DWT->CYCCNT;
+			initDistField();
+			cycles[0] += DWT->CYCCNT-start;
+			start = DWT->CYCCNT;
+			astarPath(0,0,ASTAR_GOAL,0,path);
+			cycles[1] += DWT->CYCCNT-start;
+			start = DWT->CYCCNT;
+			chooseFrontier(0,0);
+			cycles[2] += DWT->CYCCNT-start;
+			start = DWT->CYCCNT;
+			pruneRegions();
+			cycles[3] += DWT->CYCCNT-start;
+			currentXpos = 0;
+			currentYpos = 0;
+			direction = defaultDir;
+			start = DWT->CYCCNT;
+			genRunVector();
+			cycles[4] += DWT->CYCCNT-start;
+			clearMoves();
+		}
+		for(uint8_t j = 0;j<5;j++)
+		{
+			plannerUs[clock][j] = cycles[j]/BENCH_REPEATS/(HAL_RCC_GetHCLKFreq()/1000000);
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  ADC1_Init()
+Description:  Configures the analog pins and starts the ADC
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Works!
+***********************************************************************************/
+static void ADC1_Init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct;
+  ADC_ChannelConfTypeDef sConfig;
+	
+	// Enable clock for GPIOA
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	
+	// Enable ADC Clock
+	__HAL_RCC_ADC_CLK_ENABLE();
+	
+	// ADC Periph interface clock configuration, PLLSAI1 so it doesn't follow the clock profile
+  __HAL_RCC_ADC_CONFIG(RCC_ADCCLKSOURCE_PLLSAI1);
+	
+	// Configure GPIOA
+	GPIO_InitStruct.Pin   = GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_3 |
+	                        GPIO_PIN_4 | GPIO_PIN_5;
+	GPIO_InitStruct.Mode  = GPIO_MODE_ANALOG;
+	GPIO_InitStruct.Pull  = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+	
+	/* Configure ADC1 */
+	hadc1.Instance = ADC1;
+	
+	// Reset peripheral
+	if(HAL_ADC_DeInit(&hadc1)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+	
+  // Configure ADC settings
+  hadc1.Init.ClockPrescaler        = ADC_CLOCK_ASYNC_DIV2;  // 4 MHz
+  hadc1.Init.Resolution            = ADC_RESOLUTION_12B;
+  hadc1.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
+  hadc1.Init.ScanConvMode          = ADC_SCAN_ENABLE;       // Scan through all channels based on rank
+  hadc1.Init.EOCSelection          = ADC_EOC_SINGLE_CONV;
+  hadc1.Init.LowPowerAutoWait      = DISABLE;
+  hadc1.Init.ContinuousConvMode    = ENABLE;
+  hadc1.Init.NbrOfConversion       = 5;                     // 5 channels to scan through
+  hadc1.Init.DiscontinuousConvMode = DISABLE;
+  hadc1.Init.NbrOfDiscConversion   = 1;
+  hadc1.Init.ExternalTrigConv      = ADC_SOFTWARE_START;
+  hadc1.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_NONE;
+  hadc1.Init.DMAContinuousRequests = DISABLE;
+  hadc1.Init.Overrun               = ADC_OVR_DATA_OVERWRITTEN;
+  hadc1.Init.OversamplingMode      = DISABLE;
+  
+	if(HAL_ADC_Init(&hadc1)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+
+  //Configure Channel 5, PA0, IR_BL
+  sConfig.Channel      = ADC_CHANNEL_5;
+  sConfig.Rank         = ADC_REGULAR_RANK_1;       // scanning will be done in order
+  sConfig.SamplingTime = ADC_SAMPLETIME_2CYCLES_5;
+  sConfig.SingleDiff   = ADC_SINGLE_ENDED;
+  sConfig.OffsetNumber = ADC_OFFSET_NONE;
+  sConfig.Offset       = 0;
+  
+	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+	
+	//Configure Channel 6, PA1, IR_FL
+  sConfig.Channel      = ADC_CHANNEL_6;
+  sConfig.Rank         = ADC_REGULAR_RANK_2;
+  
+	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+	
+	//Configure Channel 8, PA3, IR_M
+  sConfig.Channel      = ADC_CHANNEL_8;
+  sConfig.Rank         = ADC_REGULAR_RANK_3;
+  
+	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+	
+	//Configure Channel 9, PA4, IR_FR
+  sConfig.Channel      = ADC_CHANNEL_9;
+  sConfig.Rank         = ADC_REGULAR_RANK_4;
+  
+	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+	
+	//Configure Channel 10, PA5, IR_BR
+  sConfig.Channel      = ADC_CHANNEL_10;
+  sConfig.Rank         = ADC_REGULAR_RANK_5;
+  
+	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+	
+	/* Run the ADC calibration in single-ended mode */
+  if (HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED) != HAL_OK)
+  {
+    /* Calibration Error */
+    while(1){}
+  }
+}
+
+/***********************************************************************************
+Function   :  TIM1_Init()
+Description:  Configure Timer 1 to run 4 PWM outputs for the motors at PWM_FREQ_HZ,
+              with the period and the compare registers preloaded. All four start
+              low, so the motors coast
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void TIM1_Init(void)
+{
+  //declares some structs for init purposes
+  TIM_ClockConfigTypeDef sClockSourceConfig;
+  TIM_OC_InitTypeDef sConfigOC;
+
+	__HAL_RCC_TIM1_CLK_ENABLE();
+
+	//sets up the base timer 
+  htim1.Instance = TIM1;
+  htim1.Init.Prescaler = 0;
+  htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim1.Init.Period = (HAL_RCC_GetPCLK2Freq()/PWM_FREQ_HZ)-1;
+  htim1.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim1.Init.RepetitionCounter = 0;
+  htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  HAL_TIM_Base_Init(&htim1);
+  
+	//sets the reference clock source
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  HAL_TIM_ConfigClockSource(&htim1, &sClockSourceConfig);
+
+	//enables the PWM functionality
+  HAL_TIM_PWM_Init(&htim1);
+
+  //configures the PWM settings and loads it to all 4 channels in use
+  sConfigOC.OCMode = TIM_OCMODE_PWM1;
+  sConfigOC.Pulse = 0;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  sConfigOC.OCNPolarity = TIM_OCNPOLARITY_HIGH;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  sConfigOC.OCIdleState = TIM_OCIDLESTATE_RESET;
+  sConfigOC.OCNIdleState = TIM_OCNIDLESTATE_RESET;
+  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_1);
+  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_2);
+  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_3);
+  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_4);
+  __HAL_TIM_ENABLE_OCxPRELOAD(&htim1, TIM_CHANNEL_1);
+  __HAL_TIM_ENABLE_OCxPRELOAD(&htim1, TIM_CHANNEL_2);
+  __HAL_TIM_ENABLE_OCxPRELOAD(&htim1, TIM_CHANNEL_3);
+  __HAL_TIM_ENABLE_OCxPRELOAD(&htim1, TIM_CHANNEL_4);
+
+	
+	//starts the timer and enables the PWM Channels
+	HAL_TIM_Base_Start(&htim1); 
+	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_1); 
+	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_2); 
+	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_3); 
+	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_4); 
+}
+
+/***********************************************************************************
+Function   :  TIM2_Init()
+Description:  Configure Timer 2 to count microseconds all the way round its 32 bits,
+              for timing the encoder edges
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void TIM2_Init(void)
+{
+	__HAL_RCC_TIM2_CLK_ENABLE();
+	
+	htim2.Instance = TIM2;
+	htim2.Init.Prescaler = (HAL_RCC_GetPCLK1Freq()/EDGE_TIMER_HZ)-1;
+	htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim2.Init.Period = 0xFFFFFFFF;
+	htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	HAL_TIM_Base_Init(&htim2);
+	HAL_TIM_Base_Start(&htim2);
+}
+
+/***********************************************************************************
+Function   :  TIM6_Init()
+Description:  Configure Timer 6 to interrupt at the control loop rate
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void TIM6_Init(void)
+{
+	__HAL_RCC_TIM6_CLK_ENABLE();
+	
+	//1 MHz timer clock, so the tick doesn't change with the system clock
+	htim6.Instance = TIM6;
+	htim6.Init.Prescaler = (HAL_RCC_GetPCLK1Freq()/1000000)-1;
+	htim6.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim6.Init.Period = (1000000/CONTROL_RATE)-1;
+	htim6.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+	HAL_TIM_Base_Init(&htim6);
+	
+	//below the encoders so no steps are missed while the tick runs
+	HAL_NVIC_SetPriority(TIM6_DAC_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(TIM6_DAC_IRQn);
+	tickDue = TIM2->CNT+TICK_US;
+	HAL_TIM_Base_Start_IT(&htim6);
+}
+
+/***********************************************************************************
+Function   :  LPTIM1_Init()
+Description:  Configure LPTIM1 to count ms off LSI, which keeps going in Stop 2. It
+              runs free over 16 bits. The compare match ends a wait in stopFor() and
+              the wrap wakes the core once a turn, so no stop is long enough for the
+              count to lap it
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void LPTIM1_Init(void)
+{
+	RCC_OscInitTypeDef RCC_OscInitStruct = {};
+	RCC_PeriphCLKInitTypeDef PeriphClkInit = {};
+	
+	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_LSI;
+	RCC_OscInitStruct.LSIState = RCC_LSI_ON;
+	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+	if(HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+	{
+		while(1){}
+	}
+	PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_LPTIM1;
+	PeriphClkInit.Lptim1ClockSelection = RCC_LPTIM1CLKSOURCE_LSI;
+	if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK)
+	{
+		while(1){}
+	}
+	__HAL_RCC_LPTIM1_CLK_ENABLE();
+	
+	//32 kHz/32, one count a ms
+	hlptim1.Instance = LPTIM1;
+	hlptim1.Init.Clock.Source = LPTIM_CLOCKSOURCE_APBCLOCK_LPOSC;
+	hlptim1.Init.Clock.Prescaler = LPTIM_PRESCALER_DIV32;
+	hlptim1.Init.Trigger.Source = LPTIM_TRIGSOURCE_SOFTWARE;
+	hlptim1.Init.OutputPolarity = LPTIM_OUTPUTPOLARITY_HIGH;
+	hlptim1.Init.UpdateMode = LPTIM_UPDATE_IMMEDIATE;
+	hlptim1.Init.CounterSource = LPTIM_COUNTERSOURCE_INTERNAL;
+	hlptim1.Init.Input1Source = LPTIM_INPUT1SOURCE_GPIO;
+	hlptim1.Init.Input2Source = LPTIM_INPUT2SOURCE_GPIO;
+	if(HAL_LPTIM_Init(&hlptim1) != HAL_OK)
+	{
+		while(1){}
+	}
+	
+	//the interrupts can only be set while it is off
+	__HAL_LPTIM_ENABLE_IT(&hlptim1,LPTIM_IT_CMPM|LPTIM_IT_ARRM);
+	HAL_NVIC_SetPriority(LPTIM1_IRQn, 4, 0);
+	HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+	__HAL_LPTIM_ENABLE(&hlptim1);
+	__HAL_LPTIM_AUTORELOAD_SET(&hlptim1,0xFFFF);
+	__HAL_LPTIM_START_CONTINUOUS(&hlptim1);
+}
+
+/***********************************************************************************
+Function   :  GPIO_Init()
+Description:  Configures GPIO pins for input, output, and external interrupt usage
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete, but may be updated with pin configs from other init functions
+***********************************************************************************/
+static void GPIO_Init(void)
+{
+
+  GPIO_InitTypeDef GPIO_InitStruct;
+
+  /* GPIO Ports Clock Enable */
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+
+  // Sets the digital output pins to LOW before enabling them
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_2|GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_RESET);
+
+	//LED Output pin config
+  /*Configure GPIO pins : PA2 PA6 PA7 */
+  GPIO_InitStruct.Pin = GPIO_PIN_2|GPIO_PIN_6|GPIO_PIN_7;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+	
+	//On Board LED Output pin config
+  /*Configure GPIO pins : PB3 */
+  GPIO_InitStruct.Pin = GPIO_PIN_3;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	//EXTI input pin config
+  /*Configure GPIO pins : PB0 PB1 PB4 PB5 */
+  GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_4|GPIO_PIN_5;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	//Button Digital Input pin config
+  /*Configure GPIO pin : PA12, interrupting only to wake the core */
+  GPIO_InitStruct.Pin = GPIO_PIN_12;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+	//Switch Digital Input pin config
+  /*Configure GPIO pins : PB6 PB7, interrupting only to wake the core */
+  GPIO_InitStruct.Pin = GPIO_PIN_6|GPIO_PIN_7;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+	
+	//PWM pin config, TIM1 channels 1 to 4
+	/*Configure GPIO pins : PA8 PA9 PA10 PA11 */
+	GPIO_InitStruct.Pin = GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;
+	GPIO_InitStruct.Alternate = GPIO_AF1_TIM1;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+}
+
+/***********************************************************************************
+Function   :  EXTI_Init()
+Description:  Sets Priority and enables the external interupts used for the encoders,
+              and the button's, below everything else. The mode switches share
+              EXTI9_5 with left B
+Inputs     :  None
+Outputs    :  None
+
+Status     :  I made this but don't know if it works
+***********************************************************************************/
+static void EXTI_Init(void)
+{
+	HAL_NVIC_SetPriority(EXTI0_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(EXTI0_IRQn);
+	HAL_NVIC_SetPriority(EXTI1_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+	HAL_NVIC_SetPriority(EXTI4_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(EXTI4_IRQn);
+	HAL_NVIC_SetPriority(EXTI9_5_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+	HAL_NVIC_SetPriority(EXTI15_10_IRQn, 4, 0);
+  HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+}
+
+/***********************************************************************************
+Function   :  analogRead()
+Description:  Gets the analog values from each of the ADC channels and loads the
+              analog value struct
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Seems to work.  Could test if struct is properly populated.
+              How values are stored in the struct should also be looked at.
+***********************************************************************************/
+static void analogRead(void)
+{
+	/* Start the conversion process */
+  if (HAL_ADC_Start(&hadc1) != HAL_OK)
+  {
+    /* Start Conversation Error */
+    while(1){}
+  }
+	
+	/* Poll for conversions */
+	for(int conv_index = 0; conv_index < 5; conv_index++)
+	{
+		if(HAL_ADC_PollForConversion(&hadc1, 10) != HAL_OK)
+		{
+			/* loop if error occured*/
+			while(1){}
+		}
+		else
+		{
+			/* store converted value based on set rank in ADC1_Init */
+			switch(conv_index)
+			{
+				case 0:  analog1.leftBackIRVal = HAL_ADC_GetValue(&hadc1);
+					break;
+				case 1:  analog1.leftFrontIRVal = HAL_ADC_GetValue(&hadc1);
+					break;
+				case 2:  analog1.middleIRVal = HAL_ADC_GetValue(&hadc1);
+					break;
+				case 3:  analog1.rightFrontIRVal = HAL_ADC_GetValue(&hadc1);
+					break;
+				case 4:  analog1.rightBackIRVal = HAL_ADC_GetValue(&hadc1);
+					break;
+			}
+		}
+	}
+	
+	/* End conversion process */
+	if (HAL_ADC_Stop(&hadc1) != HAL_OK)
+	{
+		/* Error occured */
+		while(1){}
+	}
+}
+#endif
+
+/***********************************************************************************
+Function   :  irRawValue()
+Description:  gives the last raw reading of one IR sensor
+Inputs     :  sensor index
+Outputs    :  raw ADC counts
+
+Status     :  Complete
+***********************************************************************************/
+static uint16_t irRawValue(uint8_t sensor)
+{
+	switch(sensor)
+	{
+		case IR_BL:  return analog1.leftBackIRVal;
+		case IR_FL:  return analog1.leftFrontIRVal;
+		case IR_M:   return analog1.middleIRVal;
+		case IR_FR:  return analog1.rightFrontIRVal;
+		default:     return analog1.rightBackIRVal;
+	}
+}
+
+/***********************************************************************************
+Function   :  irToMM()
+Description:  converts a raw IR reading to mm along the sensor beam by interpolating
+              the sensor's calibration table. Readings past either end of the table
+              are clamped to that end
+Inputs     :  sensor index, raw ADC counts
+Outputs    :  distance in mm
+
+Status     :  Complete
+***********************************************************************************/
+static uint16_t irToMM(uint8_t sensor, uint16_t raw)
+{
+	const uint16_t *table = irCal.raw[sensor];
+	uint32_t scale = irBeamScale[sensor] ? irBeamScale[sensor] : 256;
+	int32_t pos = -1;      //position in the table, 256 per calibration point
+	int32_t lo, hi;
+	
+	//the readings can rise or fall with distance, but always in the same direction
+	for(int i = 0;i<IR_CAL_POINTS-1;i++)
+	{
+		lo = table[i];
+		hi = table[i+1];
+		if(((raw>=lo)&&(raw<=hi))||((raw<=lo)&&(raw>=hi)))
+		{
+			pos = (hi == lo) ? i*256 : i*256+((raw-lo)*256)/(hi-lo);
+			break;
+		}
+	}
+	if(pos<0)
+	{
+		//off the end of the table, clamp to whichever end the reading is beyond
+		lo = table[0];
+		hi = table[IR_CAL_POINTS-1];
+		if(((hi>=lo)&&(raw>hi))||((hi<lo)&&(raw<hi)))
+		{
+			pos = (IR_CAL_POINTS-1)*256;
+		}
+		else
+		{
+			pos = 0;
+		}
+	}
+	return ((IR_CAL_START_MM*256+pos*IR_CAL_STEP_MM)*scale)>>16;
+}
+
+/***********************************************************************************
+Function   :  irLinearize()
+Description:  converts the latest raw IR readings to mm
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void irLinearize(void)
+{
+	wallDist.leftBackIRVal = irToMM(IR_BL,analog1.leftBackIRVal);
+	wallDist.leftFrontIRVal = irToMM(IR_FL,analog1.leftFrontIRVal);
+	wallDist.middleIRVal = irToMM(IR_M,analog1.middleIRVal);
+	wallDist.rightFrontIRVal = irToMM(IR_FR,analog1.rightFrontIRVal);
+	wallDist.rightBackIRVal = irToMM(IR_BR,analog1.rightBackIRVal);
+}
+
+/***********************************************************************************
+Function   :  loadIRCal()
+Description:  loads the IR calibration tables from flash. If the uMouse has never
+              been calibrated, the tables are filled so each sensor reads its wall
+              distance at WALL_THRESHOLD_S, which behaves like the old raw thresholds
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void loadIRCal(void)
+{
+	const irCalibration *stored = (const irCalibration*)IR_CAL_ADDR;
+	uint32_t wallMM, beamMM;
+	
+#ifndef HOST_BUILD
+	if(stored->magic == IR_CAL_MAGIC)
+	{
+		irCal = *stored;
+		return;
+	}
+#else
+	(void)stored;
+#endif
+	for(int s = 0;s<IR_SENSORS;s++)
+	{
+		wallMM = (s == IR_M) ? WALL_FRONT_MM : WALL_SIDE_MM;
+		for(int i = 0;i<IR_CAL_POINTS;i++)
+		{
+			beamMM = ((IR_CAL_START_MM+i*IR_CAL_STEP_MM)*(irBeamScale[s] ? irBeamScale[s] : 256))>>8;
+			irCal.raw[s][i] = (beamMM*WALL_THRESHOLD_S)/wallMM;
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  saveRun()
+Description:  saves the solved map and the speed run program queued for it to flash,
+              so the run survives a reset. Only a complete map is saved, and the page
+              is only written if it holds something else
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void saveRun(void)
+{
+	uint16_t length = (progTail-progHead)&(MOVE_PROGRAM_SIZE-1);
+	
+	if((checkMapComplete() == 0)||(length>=MOVE_PROGRAM_SIZE-1))
+	{
+		return;
+	}
+	memset(&savedRun,0,sizeof(savedRun));
+	savedRun.magic = RUN_STORE_MAGIC;
+	savedRun.profileIndex = profileIndex;
+	savedRun.defaultDir = defaultDir;
+	savedRun.length = length+1;
+	memcpy(savedRun.walls,MAP.walls,sizeof(savedRun.walls));
+	memcpy(savedRun.scanned,MAP.scanned,sizeof(savedRun.scanned));
+	for(uint16_t i = 0;i<length;i++)
+	{
+		savedRun.program[i] = moveProgram[(progHead+i)&(MOVE_PROGRAM_SIZE-1)];
+	}
+	savedRun.program[length] = OP_STOP;
+#ifndef HOST_BUILD
+	if(memcmp((const void*)RUN_STORE_ADDR,&savedRun,sizeof(savedRun)) == 0)
+	{
+		return;
+	}
+#endif
+	flashWrite(RUN_STORE_ADDR,&savedRun,sizeof(savedRun));
+}
+
+/***********************************************************************************
+Function   :  loadRun()
+Description:  queues the speed run saved in flash. After a reset nothing has been
+              scanned, so the saved map is put back first. A map searched since then
+              has to match the saved one, and the run has to have been planned for the profile and
+              start direction in use, otherwise a new run is planned
+Inputs     :  None
+Outputs    :  1 if the saved run is queued
+
+Status     :  Complete
+***********************************************************************************/
+static bool loadRun(void)
+{
+	const runStore *stored = (const runStore*)RUN_STORE_ADDR;
+	movementVector move;
+	
+#ifndef HOST_BUILD
+	savedRun = *stored;
+#else
+	(void)stored;
+#endif
+	if((savedRun.magic != RUN_STORE_MAGIC)||(savedRun.length == 0)||(savedRun.length>MOVE_PROGRAM_SIZE))
+	{
+		return 0;
+	}
+	if(cellFlag(MAP.scanned,0) == 0)
+	{
+		memcpy(MAP.walls,savedRun.walls,sizeof(MAP.walls));
+		memcpy(MAP.scanned,savedRun.scanned,sizeof(MAP.scanned));
+		memset(MAP.pruned,0,sizeof(MAP.pruned));
+		//a saved map was good enough for a run, so its walls start out fully trusted
+		for(uint16_t wall = 0;wall<2*WALL_ROWS;wall++)
 		{
-			targetCell = workingCell;
-			targetPosFound = 1;
+			MAP.votes[wall] = ((MAP.walls[wall>>2]>>((wall&0x03)*2))&WALL_CLOSED) ? WALL_VOTE_MAX :
+			                  ((MAP.walls[wall>>2]>>((wall&0x03)*2))&WALL_SEEN) ? -WALL_VOTE_MAX : 0;
 		}
-		
-		//if there is a path from the currently loaded cell and the fill value of that cell is 0, set fillVal and add to stack.
-		for(int j = 0;j<4;j++)
+		initDistField();
+		pruneRegions();
+	}
+	//only the closed bits, a search since the reset may have seen more open walls
+	for(uint16_t i = 0;i<WALL_BYTES;i++)
+	{
+		if(((MAP.walls[i]^savedRun.walls[i])&0x55) != 0)
 		{
-			// checks the walls in the order of WEST, SOUTH, EAST, NORTH
-			if((workingCell.walls&(0x1<<j)) != (0x1<<j))
-			{
-				switch(j)
-				{
-					case(0):
-						if(MAP[workingCell.xPos-1][workingCell.yPos].fillVal != 0)
-						{
-							MAP[workingCell.xPos-1][workingCell.yPos].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos-1][workingCell.yPos]);
-						}
-					break;
-					case(1):
-						if(MAP[workingCell.xPos][workingCell.yPos-1].fillVal != 0)
-						{
-							MAP[workingCell.xPos][workingCell.yPos-1].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos][workingCell.yPos-1]);
-						}
-					break;
-					case(2):
-						if(MAP[workingCell.xPos+1][workingCell.yPos].fillVal != 0)
-						{
-							MAP[workingCell.xPos+1][workingCell.yPos].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos+1][workingCell.yPos]);
-						}
-					break;
-					case(3):
-						if(MAP[workingCell.xPos][workingCell.yPos+1].fillVal != 0)
-						{
-							MAP[workingCell.xPos][workingCell.yPos+1].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos][workingCell.yPos+1]);
-						}
-					break;
-				}
-			}	
+			return 0;
 		}
 	}
+	if((savedRun.profileIndex != profileIndex)||(savedRun.defaultDir != defaultDir))
+	{
+		return 0;
+	}
 	
-	//fills the moveStack with The steps needed to get to the target cell
-	for(int i = 0;i<targetCell.fillVal;i++)
+	//builds any turn shapes the program needs before it runs
+	clearMoves();
+	runCurveCount = 0;
+	for(uint16_t i = 0;i+1<savedRun.length;i++)
 	{
-		//next cell West
-		if(MAP[workingCell.xPos-1][workingCell.yPos].fillVal == (workingCell.fillVal-1))
+		if(decodeOp(savedRun.program[i],&move) == 0)
 		{
-			if(previousCell.fillVal != 0)
-			{
-				if(previousCell.xPos == workingCell.xPos)
-				{
-					if((previousCell.yPos>workingCell.yPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnLeftMove);
-						turned = 1;
-					}
-					if((previousCell.yPos<workingCell.yPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnRightMove);
-						turned = 1;
-					}
-				}
-			}
-			moveStack.push_back(forwardMove);
-			previousCell = workingCell;
-			workingCell = MAP[workingCell.xPos-1][workingCell.yPos];
+			return 0;
+		}
+		pushOp(savedRun.program[i]);
+	}
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  calibrateIR()
+Description:  IR calibration mode. Start with the uMouse facing a wall, IR_CAL_START_MM
+              away from it. The uMouse backs away IR_CAL_STEP_MM at a time and records
+              the averaged readings at each point, then saves the tables to flash
+Inputs     :  None
+Outputs    :  None
+
+Status     :  Complete
+***********************************************************************************/
+static void calibrateIR(void)
+{
+	irCalibration cal = irCal;
+	uint32_t sum[IR_SENSORS];
+	
+	for(int i = 0;i<IR_CAL_POINTS;i++)
+	{
+		HAL_Delay(IR_CAL_SETTLE_MS);
+		for(int s = 0;s<IR_SENSORS;s++)
+		{
+			sum[s] = 0;
 		}
-		//next cell East
-		if(MAP[workingCell.xPos+1][workingCell.yPos].fillVal == (workingCell.fillVal-1))
+		//the readings are refreshed every control tick
+		for(int n = 0;n<IR_CAL_SAMPLES;n++)
 		{
-			if(previousCell.fillVal != 0)
+			for(int s = 0;s<IR_SENSORS;s++)
 			{
-				if(previousCell.xPos == workingCell.xPos)
-				{
-					if((previousCell.yPos>workingCell.yPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnRightMove);
-						turned = 1;
-					}
-					if((previousCell.yPos<workingCell.yPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnLeftMove);
-						turned = 1;
-					}
-				}
+				sum[s] += irRawValue(s);
 			}
-			moveStack.push_back(forwardMove);
-			previousCell = workingCell;
-			workingCell = MAP[workingCell.xPos+1][workingCell.yPos];
+			HAL_Delay(1);
 		}
-		//next cell South
-		if(MAP[workingCell.xPos][workingCell.yPos-1].fillVal == (workingCell.fillVal-1))
+		for(int s = 0;s<IR_SENSORS;s++)
 		{
-			if(previousCell.fillVal != 0)
+			if(irBeamScale[s] != 0)
 			{
-				if(previousCell.yPos == workingCell.yPos)
-				{
-					if((previousCell.xPos>workingCell.xPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnLeftMove);
-						turned = 1;
-					}
-					if((previousCell.xPos<workingCell.xPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnRightMove);
-						turned = 1;
-					}
-				}
+				cal.raw[s][i] = sum[s]/IR_CAL_SAMPLES;
 			}
-			moveStack.push_back(forwardMove);
-			previousCell = workingCell;
-			workingCell = MAP[workingCell.xPos][workingCell.yPos-1];
 		}
-		//next cell South
-		if(MAP[workingCell.xPos][workingCell.yPos+1].fillVal == (workingCell.fillVal-1))
+		if(i<IR_CAL_POINTS-1)
 		{
-			if(previousCell.fillVal != 0)
-			{
-				if(previousCell.yPos == workingCell.yPos)
-				{
-					if((previousCell.xPos>workingCell.xPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnRightMove);
-						turned = 1;
-					}
-					if((previousCell.xPos<workingCell.xPos)&&(turned == 0))
-					{
-						moveStack.push_back(turnLeftMove);
-						turned = 1;
-					}
-				}
-			}
-			moveStack.push_back(forwardMove);
-			previousCell = workingCell;
-			workingCell = MAP[workingCell.xPos][workingCell.yPos+1];
+			pushOp(OP_BACK|IR_CAL_STEP_MM);
+			exeMoveVector();
 		}
-		turned = 0;
 	}
+	
+	cal.magic = IR_CAL_MAGIC;
+	cal.spare = 0;
+	flashWrite(IR_CAL_ADDR,&cal,sizeof(cal));
+	irCal = cal;
+	
+	//the uMouse was moved by hand, start over from the start cell
+	currentXpos = 0;
+	currentYpos = 0;
+	direction = defaultDir;
+	initPose();
 }
 
 /***********************************************************************************
-Function   :  genStartVector()
-Description:  generates the movement steps to get to position (0,0)
-Inputs     :  None
+Function   :  flashWrite()
+Description:  erases one flash page and programs it with the given data
+Inputs     :  page address, data, length in bytes (multiple of 8, at most one page)
 Outputs    :  None
 
-Status     :  floodfill done 
+Status     :  Complete
 ***********************************************************************************/
-void genStartVector(void)
+static void flashWrite(uint32_t address, const void *data, uint32_t length)
 {
-	//reset the fillVals so that past iterations of flood fill dont interfere
-	resetFillVals();
-	map workingCell, targetCell, previousCell,nextCell;
-	bool targetPosFound = 0;
-	bool turned = 0;
-	
-	//load current position as the starting point and set fillVal
-	MAP[currentXpos][currentYpos].fillVal = 0x8000;
-	floodStack.insert(0,MAP[currentXpos][currentYpos]);
+#ifndef HOST_BUILD
+	FLASH_EraseInitTypeDef erase;
+	uint32_t pageError;
+	uint64_t doubleWord;
 	
-	//while the destination hasn't been found yet
-	while(targetPosFound == 0)
+	HAL_FLASH_Unlock();
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = FLASH_BANK_1;
+	erase.Page = (address-FLASH_BASE)/FLASH_PAGE_SIZE;
+	erase.NbPages = 1;
+	if(HAL_FLASHEx_Erase(&erase,&pageError) != HAL_OK)
 	{
-		//load a cell off the stack 
-		workingCell = floodStack.back();
-		floodStack.pop_back();
-		
-		//if the start point of the maze gets filled 
-		if(MAP[0][0].fillVal != 0)
-		{
-			targetPosFound = 1;
-		}
-		
-		//if there is a path from the currently loaded cell and the fill value of that cell is 0, set fillVal and add to stack.
-		for(int j = 0;j<4;j++)
+		/* Error occured */
+		while(1){}
+	}
+	for(uint32_t i = 0;i<length;i+=8)
+	{
+		memcpy(&doubleWord,(const uint8_t*)data+i,8);
+		if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD,address+i,doubleWord) != HAL_OK)
 		{
-			// checks the walls in the order of WEST, SOUTH, EAST, NORTH
-			if((workingCell.walls&(0x1<<j)) != (0x1<<j))
-			{
-				switch(j)
-				{
-					case(0):
-						if(MAP[workingCell.xPos-1][workingCell.yPos].fillVal != 0)
-						{
-							MAP[workingCell.xPos-1][workingCell.yPos].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos-1][workingCell.yPos]);
-						}
-					break;
-					case(1):
-						if(MAP[workingCell.xPos][workingCell.yPos-1].fillVal != 0)
-						{
-							MAP[workingCell.xPos][workingCell.yPos-1].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos][workingCell.yPos-1]);
-						}
-					break;
-					case(2):
-						if(MAP[workingCell.xPos+1][workingCell.yPos].fillVal != 0)
-						{
-							MAP[workingCell.xPos+1][workingCell.yPos].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos+1][workingCell.yPos]);
-						}
-					break;
-					case(3):
-						if(MAP[workingCell.xPos][workingCell.yPos+1].fillVal != 0)
-						{
-							MAP[workingCell.xPos][workingCell.yPos+1].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos][workingCell.yPos+1]);
-						}
-					break;
-				}
-			}	
+			/* Error occured */
+			while(1){}
 		}
 	}
-	//more stuff goes here
+	HAL_FLASH_Lock();
+#else
+	(void)address;
+	(void)data;
+	(void)length;
+#endif
 }
 
 /***********************************************************************************
-Function   :  genRunVector()
-Description:  generates the movement steps of the solution to the maze
+Function   :  logArm()
+Description:  erases the input log so the move programs that follow are recorded.
+              Takes about 1.5 s, so it is done while waiting to start. The core
+              stands while a page erases, so it goes a page at a time to let the
+              interrupts in between, and SysTick, which only catches one of the ms
+              it stood through, is moved on by what LPTIM1 counted
 Inputs     :  None
 Outputs    :  None
 
-
-Status     :  floodfill done
+Status     :  Complete
 ***********************************************************************************/
-void genRunVector(void)
+static void logArm(void)
 {
-	//reset the fillVals so that past iterations of flood fill dont interfere
-	resetFillVals();
-	map workingCell, targetCell, previousCell,nextCell;
-	bool targetPosFound = 0;
-	bool turned = 0;
-	
-	//load start position as the starting point and set fillVal
-	MAP[0][0].fillVal = 0x8000;
-	floodStack.insert(0,MAP[0][0]);
+	logging = 0;
+	logArmed = 0;
+	logUsed = 0;
+	logIn = 0;
+	logOut = 0;
+	if(inputLogging == 0)
+	{
+		return;
+	}
+#ifndef HOST_BUILD
+	FLASH_EraseInitTypeDef erase;
+	uint32_t pageError;
+	uint32_t ticked;
+	uint16_t before;
+	uint16_t stood;
 	
-	//while the center square hasn't been found yet
-	while(targetPosFound == 0)
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = FLASH_BANK_1;
+	erase.NbPages = 1;
+	for(uint32_t page = 0;page<LOG_BYTES/LOG_PAGE_BYTES;page++)
 	{
-		//load a cell off the stack 
-		workingCell = floodStack.back();
-		floodStack.pop_back();
-		
-		//if the center square has been filled
-		if(MAP[8][8].fillVal != 0)
+		before = lptimNow();
+		ticked = uwTick;
+		erase.Page = (LOG_ADDR-FLASH_BASE)/LOG_PAGE_BYTES+page;
+		HAL_FLASH_Unlock();
+		if(HAL_FLASHEx_Erase(&erase,&pageError) != HAL_OK)
 		{
-			targetPosFound = 1;
+			/* Error occured */
+			while(1){}
 		}
-		
-		//check walls of working cell. if there is a path, add the adjacent cell to the stack and set its fillVal
-		for(int j = 0;j<4;j++)
+		HAL_FLASH_Lock();
+		stood = (uint16_t)(lptimNow()-before);
+		ticked = uwTick-ticked;
+		if(stood>ticked)
 		{
-			// checks the walls in the order of WEST, SOUTH, EAST, NORTH
-			if((workingCell.walls&(0x1<<j)) != (0x1<<j))
-			{
-				switch(j)
-				{
-					case(0):
-						if(MAP[workingCell.xPos-1][workingCell.yPos].fillVal != 0)
-						{
-							MAP[workingCell.xPos-1][workingCell.yPos].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos-1][workingCell.yPos]);
-						}
-					break;
-					case(1):
-						if(MAP[workingCell.xPos][workingCell.yPos-1].fillVal != 0)
-						{
-							MAP[workingCell.xPos][workingCell.yPos-1].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos][workingCell.yPos-1]);
-						}
-					break;
-					case(2):
-						if(MAP[workingCell.xPos+1][workingCell.yPos].fillVal != 0)
-						{
-							MAP[workingCell.xPos+1][workingCell.yPos].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos+1][workingCell.yPos]);
-						}
-					break;
-					case(3):
-						if(MAP[workingCell.xPos][workingCell.yPos+1].fillVal != 0)
-						{
-							MAP[workingCell.xPos][workingCell.yPos+1].fillVal = (workingCell.fillVal+1);
-							floodStack.insert(0,MAP[workingCell.xPos][workingCell.yPos+1]);
-						}
-					break;
-				}
-			}	
+			uwTick += stood-ticked;
 		}
 	}
-	//more stuff goes here
+#else
+	memset(hostLog,LOG_BLANK,sizeof(hostLog));
+#endif
+	logArmed = 1;
 }
 
 /***********************************************************************************
-Function   :  setNewPos()
-Description:  Sets the uMouse's position and direction to the values they will be 
-              at the destination of the move
-Inputs     :  Movement
+Function   :  logStart()
+Description:  starts recording a move program. The map, the planner state and the
+              program go in first, then the encoder, pose and sensor state is taken
+              with the interrupts off and the control tick records from there on
+Inputs     :  None
 Outputs    :  None
 
-Status     :  Complete for current implementation
+Status     :  Complete
 ***********************************************************************************/
-void setNewPos(Movement move)
+static void logStart(void)
 {
-	if(move == forward)
+	logSnapshot snap;
+	logState state;
+	uint16_t length = (progTail-progHead)&(MOVE_PROGRAM_SIZE-1);
+	
+	if((inputLogging == 0)||(logArmed == 0))
 	{
-		switch (direction)
-		{
-			case NORTH:
-				currentYpos++;
-				break;
-			case WEST:
-				currentXpos++;
-				break;
-			case SOUTH:
-				currentYpos--;
-				break;
-			case EAST:
-				currentXpos--;
-				break;
-		}
+		return;
 	}
-	if(move == turnRight)
+	//needs room for the whole header and some ticks, the rest of the log is left blank
+	if(logUsed+sizeof(snap)+sizeof(MAP)+length+sizeof(state)+sizeof(logResult)+LOG_RING>LOG_BYTES)
 	{
-		direction++;
-		direction %= 0x04;
+		logArmed = 0;
+		return;
 	}
-	if(move == turnLeft)
+	
+	snap.xPos = currentXpos;
+	snap.yPos = currentYpos;
+	snap.direction = direction;
+	snap.defaultDir = defaultDir;
+	snap.profileIndex = profileIndex;
+	snap.flags = searchMode|(goalReached<<1)|(frontierScoring<<2)|(regionPruning<<3)|(diagonalRuns<<4);
+	snap.programLength = length;
+	snap.irCal = irCal;
+	logPut(LOG_TAG_START);
+	logWrite(&snap,sizeof(snap));
+	logWrite(&MAP,sizeof(MAP));
+	for(uint16_t i = 0;i<length;i++)
 	{
-		direction--;
-		direction %= 0x04;
+		logWrite(&moveProgram[(progHead+i)&(MOVE_PROGRAM_SIZE-1)],1);
 	}
-	if(move == turnAround)
+	logDrain(0);
+	
+	//nothing the tick changes can move between taking the state and the first tick record
+	__disable_irq();
+	state.enCountRight = enCountRight;
+	state.enCountLeft = enCountLeft;
+	state.enBaseRight = enBaseRight;
+	state.enBaseLeft = enBaseLeft;
+	state.enPosRight = enPosRight;
+	state.enPosLeft = enPosLeft;
+	state.lastEnPosRight = lastEnPosRight;
+	state.lastEnPosLeft = lastEnPosLeft;
+	state.pose = pose;
+	state.switches = logSwitches();
+	state.wallSeen = leftWallSeen|(rightWallSeen<<1);
+	memcpy(state.wallHistory,wallHistory,sizeof(wallHistory));
+	logWrite(&state,sizeof(state));
+	for(int i = 0;i<LOG_PREDICT_TICKS;i++)
 	{
-		direction++;
-		direction++;
-		direction %= 0x04;
+		logPastRight[i] = lastEnPosRight;
+		logPastLeft[i] = lastEnPosLeft;
 	}
+	logPastAt = 0;
+	logLastWalls = (wallHistory[0]&0x01)|((wallHistory[1]&0x01)<<1)|((wallHistory[2]&0x01)<<2);
+	logLastPosRight = lastEnPosRight;
+	logLastPosLeft = lastEnPosLeft;
+	logLastCountRight = enCountRight;
+	logLastCountLeft = enCountLeft;
+	logLastSwitches = state.switches;
+	logStartHead = progHead;
+	logTicks = 0;
+	logBitBuf = 0;
+	logBitCount = 0;
+	logCut = 0;
+	logging = 1;
+	__enable_irq();
 }
 
 /***********************************************************************************
-Function   :  resetEnCount()
-Description:  resets the encoder count
+Function   :  logStop()
+Description:  stops recording and writes where the move program ended up, then
+              programs whatever is left of the log into flash. A program the ring
+              overflowed on only gets a mark that its ticks stop short
 Inputs     :  None
 Outputs    :  None
 
 Status     :  Complete
 ***********************************************************************************/
-void resetEnCounts()
-{
-	enCountRight = 0;
-	enCountLeft = 0;
-}
-
-/***********************************************************************************
-Function   :  SystemClock_Config()
-Description:  Configures the Base Clock that all other periferals use
-Inputs     :  None
-Outputs    :  None
-
-Status     :  Probably works? Auto-generated code
-***********************************************************************************/
-void SystemClock_Config(void)
+static void logStop(void)
 {
-
-  RCC_OscInitTypeDef RCC_OscInitStruct;
-  RCC_ClkInitTypeDef RCC_ClkInitStruct;
-  RCC_PeriphCLKInitTypeDef PeriphClkInit;
-
-    /**Initializes the CPU, AHB and APB busses clocks 
-    */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
-  RCC_OscInitStruct.MSIState = RCC_MSI_ON;
-  RCC_OscInitStruct.MSICalibrationValue = 0;
-  RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_6;
-  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
-  HAL_RCC_OscConfig(&RCC_OscInitStruct);
-
-    /**Initializes the CPU, AHB and APB busses clocks 
-    */
-  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
-                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
-  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
-  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
-  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-
-  HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0);
-
-  PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_ADC;
-  PeriphClkInit.AdcClockSelection = RCC_ADCCLKSOURCE_PLLSAI1;
-  PeriphClkInit.PLLSAI1.PLLSAI1Source = RCC_PLLSOURCE_MSI;
-  PeriphClkInit.PLLSAI1.PLLSAI1M = 1;
-  PeriphClkInit.PLLSAI1.PLLSAI1N = 16;
-  PeriphClkInit.PLLSAI1.PLLSAI1P = RCC_PLLP_DIV7;
-  PeriphClkInit.PLLSAI1.PLLSAI1Q = RCC_PLLQ_DIV2;
-  PeriphClkInit.PLLSAI1.PLLSAI1R = RCC_PLLR_DIV2;
-  PeriphClkInit.PLLSAI1.PLLSAI1ClockOut = RCC_PLLSAI1_ADC1CLK;
-  HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit);
-
-    /**Configure the main internal regulator output voltage 
-    */
-  HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1);
-
-    /**Configure the Systick interrupt time 
-    */
-  HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq()/1000);
-
-    /**Configure the Systick 
-    */
-  HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK);
-
-  /* SysTick_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0);
+	logResult result;
+	
+	if((logging == 0)&&(logCut == 0))
+	{
+		return;
+	}
+	__disable_irq();
+	logging = 0;
+	__enable_irq();
+	
+	//the tick may have left the ring nearly full
+	logDrain(0);
+	if(logCut == 1)
+	{
+		logCut = 0;
+		logMark(LOG_MARK_CUT);
+		logBits(0,(8-logBitCount)&0x07);
+		logDrain(1);
+		return;
+	}
+	result.enCountRight = enCountRight;
+	result.enCountLeft = enCountLeft;
+	getPose(&result.pose);
+	result.mapHash = logMapHash();
+	result.ticks = logTicks;
+	result.xPos = currentXpos;
+	result.yPos = currentYpos;
+	result.direction = direction;
+	result.goalReached = goalReached;
+	logMark(LOG_MARK_END);
+	logBits(0,(8-logBitCount)&0x07);
+	logWrite(&result,sizeof(result));
+	logDrain(1);
 }
 
 /***********************************************************************************
-Function   :  ADC1_Init()
-Description:  Configures the analog pins and starts the ADC
-Inputs     :  None
+Function   :  logTick()
+Description:  records one control tick as a few bits: the quadrature steps, the
+              encoder edges the main loop had seen when the tick began and the wall
+              readings sampleWalls() just took, which are all the tick takes from the
+              IR. Each wheel's steps are predicted as the mean of its last
+              LOG_PREDICT_TICKS rounded down, so a wheel at a steady speed between two
+              step counts is either as predicted or a step over. The codes, first bit
+              first:
+                r l           r and l 1 for the right and the left wheel a step over,
+                              not both, nothing else changed
+                110           both wheels a step over
+                111 f         a full record with flags f, the step errors as values,
+                              then the edge values and the wall readings if flagged
+              Values go in as 0 for nought, 10 for one, otherwise 11 and a signed
+              nibble, anything past +-7 as an escape nibble and a whole 16 bit value.
+              A full code with no flags is a mark: a switch change before the tick
+              and a check record with the pose every LOG_CHECK_TICKS after it. If the
+              ring can't take the record the recording stops, and logStop() marks the
+              program cut short
+Inputs     :  right and left edge counts at the start of the tick
 Outputs    :  None
 
-Status     :  Works!
+Status     :  Complete
 ***********************************************************************************/
-static void ADC1_Init(void)
+static void logTick(uint32_t right, uint32_t left)
 {
-	GPIO_InitTypeDef GPIO_InitStruct;
-  ADC_ChannelConfTypeDef sConfig;
-	
-	// Enable clock for GPIOA
-	__HAL_RCC_GPIOA_CLK_ENABLE();
-	
-	// Enable ADC Clock
-	__HAL_RCC_ADC_CLK_ENABLE();
-	
-	// ADC Periph interface clock configuration
-  __HAL_RCC_ADC_CONFIG(RCC_ADCCLKSOURCE_SYSCLK);
-	
-	// Configure GPIOA
-	GPIO_InitStruct.Pin   = GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_3 |
-	                        GPIO_PIN_4 | GPIO_PIN_5;
-	GPIO_InitStruct.Mode  = GPIO_MODE_ANALOG;
-	GPIO_InitStruct.Pull  = GPIO_NOPULL;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-	
-	/* Configure ADC1 */
-	hadc1.Instance = ADC1;
-	
-	// Reset peripheral
-	if(HAL_ADC_DeInit(&hadc1)!=HAL_OK)
-	{
-		/* Error occured */
-		while(1){}
-	}
+	int32_t dRight, dLeft, extraRight, extraLeft, errRight, errLeft;
+	uint8_t switches, walls;
+	uint8_t full = 0;
+	logCheck check;
 	
-  // Configure ADC settings
-  hadc1.Init.ClockPrescaler        = ADC_CLOCK_ASYNC_DIV1;
-  hadc1.Init.Resolution            = ADC_RESOLUTION_12B;
-  hadc1.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
-  hadc1.Init.ScanConvMode          = ADC_SCAN_ENABLE;       // Scan through all channels based on rank
-  hadc1.Init.EOCSelection          = ADC_EOC_SINGLE_CONV;
-  hadc1.Init.LowPowerAutoWait      = DISABLE;
-  hadc1.Init.ContinuousConvMode    = ENABLE;
-  hadc1.Init.NbrOfConversion       = 5;                     // 5 channels to scan through
-  hadc1.Init.DiscontinuousConvMode = DISABLE;
-  hadc1.Init.NbrOfDiscConversion   = 1;
-  hadc1.Init.ExternalTrigConv      = ADC_SOFTWARE_START;
-  hadc1.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_NONE;
-  hadc1.Init.DMAContinuousRequests = DISABLE;
-  hadc1.Init.Overrun               = ADC_OVR_DATA_OVERWRITTEN;
-  hadc1.Init.OversamplingMode      = DISABLE;
-  
-	if(HAL_ADC_Init(&hadc1)!=HAL_OK)
+	if(logging == 0)
 	{
-		/* Error occured */
-		while(1){}
+		return;
 	}
-
-  //Configure Channel 5, PA0, IR_BL
-  sConfig.Channel      = ADC_CHANNEL_5;
-  sConfig.Rank         = ADC_REGULAR_RANK_1;       // scanning will be done in order
-  sConfig.SamplingTime = ADC_SAMPLETIME_2CYCLES_5;
-  sConfig.SingleDiff   = ADC_SINGLE_ENDED;
-  sConfig.OffsetNumber = ADC_OFFSET_NONE;
-  sConfig.Offset       = 0;
-  
-	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	if(LOG_RING-1-((logIn-logOut)&(LOG_RING-1))<LOG_TICK_MAX)
 	{
-		/* Error occured */
-		while(1){}
+		logging = 0;
+		logCut = 1;
+		return;
 	}
 	
-	//Configure Channel 6, PA1, IR_FL
-  sConfig.Channel      = ADC_CHANNEL_6;
-  sConfig.Rank         = ADC_REGULAR_RANK_2;
-  
-	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	//the steps updatePose() just took, and any edges that went back and forth
+	dRight = lastEnPosRight-logLastPosRight;
+	dLeft = lastEnPosLeft-logLastPosLeft;
+	extraRight = (int32_t)(right-logLastCountRight)-abs(dRight);
+	extraLeft = (int32_t)(left-logLastCountLeft)-abs(dLeft);
+	//arithmetic shifts, so the mean rounds down going backward too
+	errRight = dRight-((logLastPosRight-logPastRight[logPastAt])>>LOG_PREDICT_SHIFT);
+	errLeft = dLeft-((logLastPosLeft-logPastLeft[logPastAt])>>LOG_PREDICT_SHIFT);
+	walls = (wallHistory[0]&0x01)|((wallHistory[1]&0x01)<<1)|((wallHistory[2]&0x01)<<2);
+	switches = logSwitches();
+	if(switches != logLastSwitches)
 	{
-		/* Error occured */
-		while(1){}
+		logMark(LOG_MARK_SWITCH);
+		logBits(switches,3);
+		logLastSwitches = switches;
 	}
-	
-	//Configure Channel 8, PA3, IR_M
-  sConfig.Channel      = ADC_CHANNEL_8;
-  sConfig.Rank         = ADC_REGULAR_RANK_3;
-  
-	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	if((errRight<0)||(errRight>1)||(errLeft<0)||(errLeft>1))
 	{
-		/* Error occured */
-		while(1){}
+		full |= LOG_FULL_STEPS;
 	}
-	
-	//Configure Channel 9, PA4, IR_FR
-  sConfig.Channel      = ADC_CHANNEL_9;
-  sConfig.Rank         = ADC_REGULAR_RANK_4;
-  
-	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	if((extraRight != 0)||(extraLeft != 0))
 	{
-		/* Error occured */
-		while(1){}
+		full |= LOG_FULL_EDGES;
+	}
+	if(walls != logLastWalls)
+	{
+		full |= LOG_FULL_WALLS;
 	}
 	
-	//Configure Channel 10, PA5, IR_BR
-  sConfig.Channel      = ADC_CHANNEL_10;
-  sConfig.Rank         = ADC_REGULAR_RANK_5;
-  
-	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig)!=HAL_OK)
+	if(full != 0)
 	{
-		/* Error occured */
-		while(1){}
+		logBits(0x07,3);
+		logBits(full,3);
+		logValue(errRight);
+		logValue(errLeft);
+		if(full&LOG_FULL_EDGES)
+		{
+			logValue(extraRight);
+			logValue(extraLeft);
+		}
+		if(full&LOG_FULL_WALLS)
+		{
+			logBits(walls,3);
+		}
+	}
+	else if((errRight == 1)&&(errLeft == 1))
+	{
+		logBits(0x03,3);
+	}
+	else
+	{
+		logBits(errRight|(errLeft<<1),2);
 	}
+	logPastRight[logPastAt] = logLastPosRight;
+	logPastLeft[logPastAt] = logLastPosLeft;
+	logPastAt = (logPastAt+1)%LOG_PREDICT_TICKS;
+	logLastWalls = walls;
+	logLastPosRight = lastEnPosRight;
+	logLastPosLeft = lastEnPosLeft;
+	logLastCountRight = right;
+	logLastCountLeft = left;
+	logTicks++;
 	
-	/* Run the ADC calibration in single-ended mode */
-  if (HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED) != HAL_OK)
-  {
-    /* Calibration Error */
-    while(1){}
-  }
+	if((logTicks%LOG_CHECK_TICKS) == 0)
+	{
+		check.pose = pose;
+		check.progHead = (progHead-logStartHead)&(MOVE_PROGRAM_SIZE-1);
+		check.spare = 0;
+		logMark(LOG_MARK_CHECK);
+		for(uint8_t i = 0;i<sizeof(check);i++)
+		{
+			logBits(((const uint8_t*)&check)[i],8);
+		}
+	}
 }
 
 /***********************************************************************************
-Function   :  TIM1_Init()
-Description:  Configure Timer 1 to run 4 PWM outputs for the motors
-Inputs     :  None
+Function   :  logValue()
+Description:  puts a signed value into a tick record. Nought and one, which most are,
+              take a bit or two, the rest a nibble if it fits or the escape nibble
+              and four more
+Inputs     :  value, kept to 16 bits
 Outputs    :  None
 
-Status     :  Probably works? Auto-generated code
+Status     :  Complete
 ***********************************************************************************/
-static void TIM1_Init(void)
+static void logValue(int32_t value)
 {
-  //declares some structs for init purposes
-  TIM_ClockConfigTypeDef sClockSourceConfig;
-  TIM_OC_InitTypeDef sConfigOC;
-
-
-	//sets up the base timer 
-  htim1.Instance = TIM1;
-  htim1.Init.Prescaler = 0;
-  htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim1.Init.Period = 256;
-  htim1.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
-  htim1.Init.RepetitionCounter = 0;
-  htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
-  HAL_TIM_Base_Init(&htim1);
-  
-	//sets the reference clock source
-  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
-  HAL_TIM_ConfigClockSource(&htim1, &sClockSourceConfig);
-
-	//enables the PWM functionality
-  HAL_TIM_PWM_Init(&htim1);
-
-  //configures the PWM settings and loads it to all 4 channels in use
-  sConfigOC.OCMode = TIM_OCMODE_PWM1;
-  sConfigOC.Pulse = 0;
-  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
-  sConfigOC.OCNPolarity = TIM_OCNPOLARITY_HIGH;
-  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
-  sConfigOC.OCIdleState = TIM_OCIDLESTATE_RESET;
-  sConfigOC.OCNIdleState = TIM_OCNIDLESTATE_RESET;
-  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_1);
-  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_2);
-  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_3);
-  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_4);
-
-	
-	//starts the timer and enables the PWM Channels
-	HAL_TIM_Base_Start(&htim1); 
-	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_1); 
-	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_2); 
-	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_3); 
-	HAL_TIM_PWM_Start(&htim1,TIM_CHANNEL_4); 
+	if((value == 0)||(value == 1))
+	{
+		logBits(value,1+value);
+		return;
+	}
+	logBits(0x03,2);
+	if((value>=-7)&&(value<=7))
+	{
+		logBits(value&0x0F,4);
+		return;
+	}
+	logBits(LOG_ESCAPE,4);
+	logBits(value&0xFFFF,16);
 }
 
 /***********************************************************************************
-Function   :  GPIO_Init()
-Description:  Configures GPIO pins for input, output, and external interrupt usage
-Inputs     :  None
+Function   :  logBits()
+Description:  packs the bits of a tick record into bytes, first bit in bit 0
+Inputs     :  bits, how many of them, up to 24
 Outputs    :  None
 
-Status     :  Complete, but may be updated with pin configs from other init functions
+Status     :  Complete
 ***********************************************************************************/
-static void GPIO_Init(void)
+static void logBits(uint32_t bits, uint8_t count)
 {
+	logBitBuf |= (bits&((1UL<<count)-1))<<logBitCount;
+	logBitCount += count;
+	while(logBitCount>=8)
+	{
+		logPut(logBitBuf&0xFF);
+		logBitBuf >>= 8;
+		logBitCount -= 8;
+	}
+}
 
-  GPIO_InitTypeDef GPIO_InitStruct;
-
-  /* GPIO Ports Clock Enable */
-  __HAL_RCC_GPIOA_CLK_ENABLE();
-  __HAL_RCC_GPIOB_CLK_ENABLE();
-
-  // Sets the digital output pins to LOW before enabling them
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_2|GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_RESET);
-
-	//LED Output pin config
-  /*Configure GPIO pins : PA2 PA6 PA7 */
-  GPIO_InitStruct.Pin = GPIO_PIN_2|GPIO_PIN_6|GPIO_PIN_7;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-	
-	//On Board LED Output pin config
-  /*Configure GPIO pins : PB3 */
-  GPIO_InitStruct.Pin = GPIO_PIN_3;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+/***********************************************************************************
+Function   :  logMark()
+Description:  starts a record that isn't a tick, a full tick code with no flags
+              followed by what kind it is
+Inputs     :  LOG_MARK_ kind
+Outputs    :  None
 
-	//EXTI input pin config
-  /*Configure GPIO pins : PB0 PB1 PB4 PB5 */
-  GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_4|GPIO_PIN_5;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+Status     :  Complete
+***********************************************************************************/
+static void logMark(uint8_t kind)
+{
+	logBits(0x07,3);
+	logBits(0,3);
+	logBits(kind,2);
+}
 
-	//Button Digital Input pin config
-  /*Configure GPIO pin : PA12 */
-  GPIO_InitStruct.Pin = GPIO_PIN_12;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+/***********************************************************************************
+Function   :  logPut()
+Description:  queues a byte for the log flash
+Inputs     :  byte
+Outputs    :  0 if the ring is full
 
-	//Switch Digital Input pin config
-  /*Configure GPIO pins : PB6 PB7 */
-  GPIO_InitStruct.Pin = GPIO_PIN_6|GPIO_PIN_7;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+Status     :  Complete
+***********************************************************************************/
+static bool logPut(uint8_t value)
+{
+	uint16_t in = logIn;
 	
-	//PWM pin config
-	/*Configure GPIO pins : PA8 PA9 PA10 PA11 */
-	//GPIO_InitStruct.Pin = GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11;
-  //GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-  //GPIO_InitStruct.Pull = GPIO_NOPULL;
-	//GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;
-	//GPIO_InitStruct.Alternate = GPIO_AF1_TIM1;
-  
-  GPIO_InitStruct.Pin = GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
+	if(((in+1)&(LOG_RING-1)) == logOut)
+	{
+		return 0;
+	}
+	logRing[in] = value;
+	logIn = (in+1)&(LOG_RING-1);
+	return 1;
 }
 
 /***********************************************************************************
-Function   :  EXTI_Init()
-Description:  Sets Priority and enables the external interupts used for the encoders
-Inputs     :  None
+Function   :  logWrite()
+Description:  queues a block for the log flash from the main loop, programming the
+              ring as it fills up
+Inputs     :  data, length in bytes
 Outputs    :  None
 
-Status     :  I made this but don't know if it works
+Status     :  Complete
 ***********************************************************************************/
-static void EXTI_Init(void)
+static void logWrite(const void *data, uint16_t length)
 {
-	HAL_NVIC_SetPriority(EXTI0_IRQn, 2, 0);
-  HAL_NVIC_EnableIRQ(EXTI0_IRQn);
-	HAL_NVIC_SetPriority(EXTI1_IRQn, 2, 0);
-  HAL_NVIC_EnableIRQ(EXTI1_IRQn);
-	HAL_NVIC_SetPriority(EXTI4_IRQn, 2, 0);
-  HAL_NVIC_EnableIRQ(EXTI4_IRQn);
-	HAL_NVIC_SetPriority(EXTI9_5_IRQn, 2, 0);
-  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+	for(uint16_t i = 0;i<length;i++)
+	{
+		while(logPut(((const uint8_t*)data)[i]) == 0)
+		{
+			logDrain(0);
+		}
+	}
 }
 
 /***********************************************************************************
-Function   :  analogRead()
-Description:  Gets the analog values from each of the ADC channels and loads the
-              analog value struct
-Inputs     :  None
+Function   :  logDrain()
+Description:  programs the queued log bytes into flash a double word at a time. Run
+              from the main loop, the control tick only fills the ring. When the log
+              is full the recording stops and the rest is dropped
+Inputs     :  1 to pad out and program a last part double word
 Outputs    :  None
 
-Status     :  Seems to work.  Could test if struct is properly populated.
-              How values are stored in the struct should also be looked at.
+Status     :  Complete
 ***********************************************************************************/
-static void analogRead(void)
+static void logDrain(bool flush)
 {
-	/* Start the conversion process */
-  if (HAL_ADC_Start(&hadc1) != HAL_OK)
-  {
-    /* Start Conversation Error */
-    while(1){}
-  }
+	uint8_t block[8];
+	uint16_t count;
 	
-	/* Poll for conversions */
-	for(int conv_index = 0; conv_index < 5; conv_index++)
+	while((((logIn-logOut)&(LOG_RING-1))>=8)||((flush == 1)&&(logIn != logOut)))
 	{
-		if(HAL_ADC_PollForConversion(&hadc1, 10) != HAL_OK)
+		if(logUsed+8>LOG_BYTES)
 		{
-			/* loop if error occured*/
-			while(1){}
+			logging = 0;
+			logCut = 0;
+			logArmed = 0;
+			logOut = logIn;
+			return;
 		}
-		else
+		count = (logIn-logOut)&(LOG_RING-1);
+		for(uint8_t i = 0;i<8;i++)
 		{
-			/* store converted value based on set rank in ADC1_Init */
-			switch(conv_index)
-			{
-				case 0:  analog1.leftBackIRVal = HAL_ADC_GetValue(&hadc1);
-					break;
-				case 1:  analog1.leftFrontIRVal = HAL_ADC_GetValue(&hadc1);
-					break;
-				case 2:  analog1.middleIRVal = HAL_ADC_GetValue(&hadc1);
-					break;
-				case 3:  analog1.rightFrontIRVal = HAL_ADC_GetValue(&hadc1);
-					break;
-				case 4:  analog1.rightBackIRVal = HAL_ADC_GetValue(&hadc1);
-					break;
-			}
+			block[i] = (i<count) ? logRing[(logOut+i)&(LOG_RING-1)] : LOG_BLANK;
+		}
+		logOut = (logOut+((count<8) ? count : 8))&(LOG_RING-1);
+#ifndef HOST_BUILD
+		uint64_t doubleWord;
+		
+		memcpy(&doubleWord,block,8);
+		HAL_FLASH_Unlock();
+		if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD,LOG_ADDR+logUsed,doubleWord) != HAL_OK)
+		{
+			/* Error occured */
+			while(1){}
 		}
+		HAL_FLASH_Lock();
+#else
+		memcpy(&hostLog[logUsed],block,8);
+#endif
+		logUsed += 8;
 	}
+}
+
+/***********************************************************************************
+Function   :  logSwitches()
+Description:  reads the mode switches and the button for the input log
+Inputs     :  None
+Outputs    :  switch 1, switch 2, button from bit 0
+
+Status     :  Complete
+***********************************************************************************/
+static uint8_t logSwitches(void)
+{
+	return ((GPIOB->IDR>>6)&0x03)|(((GPIOA->IDR>>12)&0x01)<<2);
+}
+
+/***********************************************************************************
+Function   :  logMapHash()
+Description:  FNV-1a hash of the map and the distance field, so a replay can check
+              it planned the same as the uMouse did
+Inputs     :  None
+Outputs    :  hash
+
+Status     :  Complete
+***********************************************************************************/
+static uint32_t logMapHash(void)
+{
+	uint32_t hash = 2166136261u;
 	
-	/* End conversion process */
-	if (HAL_ADC_Stop(&hadc1) != HAL_OK)
+	for(uint16_t i = 0;i<sizeof(MAP);i++)
 	{
-		/* Error occured */
-		while(1){}
+		hash = (hash^((const uint8_t*)&MAP)[i])*16777619u;
 	}
+	return hash;
 }
 
 /***********************************************************************************
@@ -1192,32 +4974,85 @@ Outputs    :  None
 
 Status     :  Complete with the current implementation
 ***********************************************************************************/
+//Encoder Handlers count and time every edge, and decode the quadrature for the odometry.
+//extiCount is only for the CPU load figures.
+//Swap the ++ and -- of a wheel if it counts backwards.
+
 //Encoder Handler for Right A
-void EXTI0_IRQHandler(void)
+extern "C" void EXTI0_IRQHandler(void)
 {
+	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_0);
+	extiCount[0]++;
   enCountRight++;
+	speedRight.edgeTime[enCountRight&(EDGE_TIMES-1)] = TIM2->CNT;
+	if(((GPIOB->IDR&0x01)==0) != ((GPIOB->IDR&0x02)==0)) enPosRight++;
+	else enPosRight--;
 	HAL_GPIO_TogglePin(GPIOB,GPIO_PIN_3);//for testing
 }
 
 //Encoder Handler for Right B
-void EXTI1_IRQHandler(void)
+extern "C" void EXTI1_IRQHandler(void)
 {
+	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_1);
+	extiCount[1]++;
   enCountRight++;
+	speedRight.edgeTime[enCountRight&(EDGE_TIMES-1)] = TIM2->CNT;
+	if(((GPIOB->IDR&0x01)==0) == ((GPIOB->IDR&0x02)==0)) enPosRight++;
+	else enPosRight--;
 	HAL_GPIO_TogglePin(GPIOB,GPIO_PIN_3);//for testing
 }
 
 //Encoder Handler for Left A
-void EXTI4_IRQHandler(void)
+extern "C" void EXTI4_IRQHandler(void)
 {
+	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_4);
+	extiCount[2]++;
   enCountLeft++;
+	speedLeft.edgeTime[enCountLeft&(EDGE_TIMES-1)] = TIM2->CNT;
+	if(((GPIOB->IDR&0x10)==0) == ((GPIOB->IDR&0x20)==0)) enPosLeft++;
+	else enPosLeft--;
 	HAL_GPIO_TogglePin(GPIOB,GPIO_PIN_3);//for testing
 }
 
-//Encoder Handler for Left B
-void EXTI5_9_IRQHandler(void)
+//Encoder Handler for Left B, the mode switches on the same line only wake the core from stopFor()
+extern "C" void EXTI9_5_IRQHandler(void)
 {
+	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_6|GPIO_PIN_7);
+	if(__HAL_GPIO_EXTI_GET_IT(GPIO_PIN_5) == 0)
+	{
+		return;
+	}
+	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_5);
+	extiCount[3]++;
   enCountLeft++;
+	speedLeft.edgeTime[enCountLeft&(EDGE_TIMES-1)] = TIM2->CNT;
+	if(((GPIOB->IDR&0x10)==0) != ((GPIOB->IDR&0x20)==0)) enPosLeft++;
+	else enPosLeft--;
 	HAL_GPIO_TogglePin(GPIOB,GPIO_PIN_3);//for testing
 }
 
+//Button Handler, it only wakes the core from stopFor()
+extern "C" void EXTI15_10_IRQHandler(void)
+{
+	__HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_12);
+}
+
+#ifndef HOST_BUILD
+//LPTIM1 Handler, it only wakes the core from stopFor()
+extern "C" void LPTIM1_IRQHandler(void)
+{
+	__HAL_LPTIM_CLEAR_FLAG(&hlptim1,LPTIM_FLAG_CMPM|LPTIM_FLAG_ARRM);
+}
+#endif
+
+//Control loop tick
+extern "C" void TIM6_DAC_IRQHandler(void)
+{
+	uint32_t start = TIM2->CNT;
+	
+	__HAL_TIM_CLEAR_IT(&htim6, TIM_IT_UPDATE);
+	controlTick();
+	cpuTick(start);
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,50 @@
+/*******************************************************************************
+  * File Name          : bench_maze.h
+  * Description        : Seeded random mazes for the host tools. Include after
+  *                      main.cpp, the maze is made with maze_gen.h and written
+  *                      straight into MAP.
+  *****************************************************************************/
+#ifndef BENCH_MAZE_H
+#define BENCH_MAZE_H
+
+#include "maze_gen.h"
+
+static uint32_t benchSeed;
+
+/***********************************************************************************
+Function   :  benchRand()
+Description:  xorshift random numbers, so every run of the bench sees the same mazes
+Inputs     :  None
+Outputs    :  random number
+***********************************************************************************/
+static uint32_t benchRand(void)
+{
+	return mazeRand(&benchSeed);
+}
+
+/***********************************************************************************
+Function   :  benchMaze()
+Description:  fills MAP with a recursive backtracker maze, then knocks out extra
+              walls to make loops. Every cell is marked scanned
+Inputs     :  number of extra walls to remove
+Outputs    :  None
+***********************************************************************************/
+static void benchMaze(int loops)
+{
+	static mazeGrid maze;
+
+	mazeBacktracker(&maze,MAP_SIZE,&benchSeed);
+	mazeAddLoops(&maze,loops,&benchSeed);
+	memset(MAP.walls,0,sizeof(MAP.walls));
+	memset(MAP.scanned,0xFF,sizeof(MAP.scanned));
+	memset(MAP.pruned,0,sizeof(MAP.pruned));
+	for(int x = 0;x<MAP_SIZE;x++)
+	{
+		for(int y = 0;y<MAP_SIZE;y++)
+		{
+			markWalls(x,y,0x0F,maze.walls[x*MAP_SIZE+y]);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*******************************************************************************
+  * File Name          : explore_bench.cpp
+  * Description        : Runs the search planner over a corpus of random mazes and
+  *                      counts the cells travelled, comparing the old closest
+  *                      unscanned cell rule with the frontier scoring in
+  *                      chooseFrontier(), each with and without pocket pruning.
+  *                      Walls are fed in through wallDist and mapCellAt(), so the
+  *                      uMouse only learns what its sensors would see.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -DHOST_BUILD tools/explore_bench.cpp -o explore_bench
+  *   ./explore_bench [mazes] [seed]
+  *****************************************************************************/
+#include "../main.cpp"
+#include "bench_maze.h"
+#include <stdio.h>
+
+static uint8_t trueWalls[MAP_SIZE][MAP_SIZE];
+
+struct exploreResult {
+	uint32_t search;      //cells travelled until the planner stops
+	uint32_t home;        //cells travelled back to the start afterwards
+	uint32_t scanned;
+	uint32_t pruned;
+	uint32_t expanded;    //cells expanded by astarPath() over the whole run
+	bool optimal;         //the proven path is as short as the real shortest path
+	bool lost;            //the way home hit a real wall or there was none
+};
+
+static void analogRead(void)
+{
+	//wallDist is filled in by simScan()
+}
+
+/***********************************************************************************
+Function   :  simScan()
+Description:  sets up wallDist the way the sensors would see the real walls of a
+              cell for WALL_SAMPLES ticks, then maps it with the firmware's mapCellAt()
+Inputs     :  x, y, facing
+Outputs    :  None
+***********************************************************************************/
+static void simScan(int8_t x, int8_t y, uint8_t facing)
+{
+	uint8_t walls = trueWalls[x][y];
+
+	wallDist.middleIRVal = (walls&(0x08>>facing)) ? 0 : 1000;
+	wallDist.leftFrontIRVal = (walls&(0x08>>((facing+3)&0x03))) ? 0 : 1000;
+	wallDist.rightFrontIRVal = (walls&(0x08>>((facing+1)&0x03))) ? 0 : 1000;
+	for(int i = 0;i<WALL_SAMPLES;i++)
+	{
+		sampleWalls();
+	}
+	mapCellAt(x,y,facing);
+}
+
+/***********************************************************************************
+Function   :  trueShortest()
+Description:  start to goal path length in the real maze
+Inputs     :  None
+Outputs    :  steps
+***********************************************************************************/
+static uint16_t trueShortest(void)
+{
+	uint8_t saved[WALL_BYTES];
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	uint16_t length;
+
+	memcpy(saved,MAP.walls,sizeof(saved));
+	memset(MAP.walls,0,sizeof(MAP.walls));
+	for(int x = 0;x<MAP_SIZE;x++)
+	{
+		for(int y = 0;y<MAP_SIZE;y++)
+		{
+			markWalls(x,y,0x0F,trueWalls[x][y]);
+		}
+	}
+	length = astarPath(0,0,ASTAR_GOAL,0,path);
+	memcpy(MAP.walls,saved,sizeof(saved));
+	return length;
+}
+
+/***********************************************************************************
+Function   :  simExplore()
+Description:  runs one search from the start cell until genSearchMove() gives up,
+              then drives home blind along genStartVector()'s path, checking each
+              step against the real walls
+Inputs     :  bit 0 frontier scoring instead of the closest unscanned cell, bit 1
+              pocket pruning
+Outputs    :  travel counts
+***********************************************************************************/
+static exploreResult simExplore(int rule)
+{
+	exploreResult result = {};
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	int8_t x = 0;
+	int8_t y = 0;
+	uint8_t facing = NORTH;
+	uint16_t steps;
+	Movement move;
+
+	memset(&MAP,0,sizeof(MAP));
+	frontierScoring = rule&0x01;
+	regionPruning = (rule&0x02)>>1;
+	goalReached = 0;
+	initDistField();
+
+	simScan(x,y,facing);
+	astarExpanded = 0;
+	move = genSearchMove(x,y,facing);
+	result.expanded += astarExpanded;
+	while(move != noMove)
+	{
+		switch(move)
+		{
+			case turnRight:   facing = (facing+1)&0x03; break;
+			case turnAround:  facing = (facing+2)&0x03; break;
+			case turnLeft:    facing = (facing+3)&0x03; break;
+			default:          break;
+		}
+		x += dirDX[facing];
+		y += dirDY[facing];
+		result.search++;
+		simScan(x,y,facing);
+		astarExpanded = 0;
+		move = genSearchMove(x,y,facing);
+		result.expanded += astarExpanded;
+	}
+
+	steps = knownPath(x,y,0,0,path);
+	result.lost = (steps == ASTAR_NONE);
+	for(uint16_t i = 0;(result.lost == 0)&&(i<steps);i++)
+	{
+		if((trueWalls[x][y]&(0x08>>path[i])) != 0)
+		{
+			result.lost = 1;
+			break;
+		}
+		x += dirDX[path[i]];
+		y += dirDY[path[i]];
+		result.home++;
+	}
+
+	for(uint16_t cell = 0;cell<MAP_SIZE*MAP_SIZE;cell++)
+	{
+		result.scanned += cellFlag(MAP.scanned,cell);
+		result.pruned += cellFlag(MAP.pruned,cell);
+	}
+	result.optimal = (knownPathLength() == trueShortest());
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	const char *names[] = {"perfect", "few loops", "many loops"};
+	const char *rules[] = {"nearest", "frontier", "nearest+p", "frontier+p"};
+	const int loops[] = {0, MAP_SIZE, MAP_SIZE*MAP_SIZE/4};
+	int mazes = (argc>1) ? atoi(argv[1]) : 200;
+	exploreResult run;
+
+	benchSeed = (argc>2) ? strtoul(argv[2],0,0) : 2463534242u;
+	printf("%d random %dx%d mazes per kind, average per maze\n\n",mazes,MAP_SIZE,MAP_SIZE);
+	printf("%-11s %-10s %8s %8s %8s %8s %8s %10s %8s %8s\n","maze","rule","search","home","total",
+	       "scanned","pruned","A* cells","optimal","lost");
+
+	for(int kind = 0;kind<3;kind++)
+	{
+		uint64_t total[4][7] = {};
+
+		for(int m = 0;m<mazes;m++)
+		{
+			benchMaze(loops[kind]);
+			for(int x = 0;x<MAP_SIZE;x++)
+			{
+				for(int y = 0;y<MAP_SIZE;y++)
+				{
+					trueWalls[x][y] = cellWalls(x,y);
+				}
+			}
+			for(int rule = 0;rule<4;rule++)
+			{
+				run = simExplore(rule);
+				total[rule][0] += run.search;
+				total[rule][1] += run.home;
+				total[rule][2] += run.scanned;
+				total[rule][3] += run.pruned;
+				total[rule][4] += run.expanded;
+				total[rule][5] += run.optimal;
+				total[rule][6] += run.lost;
+			}
+		}
+		for(int rule = 0;rule<4;rule++)
+		{
+			printf("%-11s %-10s %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f %7.0f%% %8llu\n",names[kind],rules[rule],
+			       (double)total[rule][0]/mazes,(double)total[rule][1]/mazes,
+			       (double)(total[rule][0]+total[rule][1])/mazes,(double)total[rule][2]/mazes,
+			       (double)total[rule][3]/mazes,(double)total[rule][4]/mazes,
+			       100.0*total[rule][5]/mazes,(unsigned long long)total[rule][6]);
+		}
+	}
+	return 0;
+}
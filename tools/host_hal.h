@@ -0,0 +1,112 @@
+/*******************************************************************************
+  * File Name          : host_hal.h
+  * Description        : Stand-ins for the HAL pieces main.cpp uses outside of the
+  *                      peripheral setup, so the maze, planner and motion code can
+  *                      be built on a PC. Tools include main.cpp directly with
+  *                      HOST_BUILD defined and supply analogRead() themselves.
+  *****************************************************************************/
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stdint.h>
+
+typedef struct {
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct {
+	uint32_t unused;
+} ADC_HandleTypeDef;
+
+typedef struct {
+	uint32_t unused;
+} TIM_HandleTypeDef;
+
+typedef struct {
+	uint32_t unused;
+} LPTIM_HandleTypeDef;
+
+typedef enum {GPIO_PIN_RESET, GPIO_PIN_SET} GPIO_PinState;
+
+// the free running timer the encoder edges are timed with, the tools move CNT on
+typedef struct {
+	volatile uint32_t CNT;
+} TIM_TypeDef;
+
+#define GPIO_PIN_0 0x0001
+#define GPIO_PIN_1 0x0002
+#define GPIO_PIN_2 0x0004
+#define GPIO_PIN_3 0x0008
+#define GPIO_PIN_4 0x0010
+#define GPIO_PIN_5 0x0020
+#define GPIO_PIN_6 0x0040
+#define GPIO_PIN_7 0x0080
+#define GPIO_PIN_12 0x1000
+
+static GPIO_TypeDef hostGPIOA;
+static GPIO_TypeDef hostGPIOB;
+#define GPIOA (&hostGPIOA)
+#define GPIOB (&hostGPIOB)
+
+static TIM_TypeDef hostTIM2;
+#define TIM2 (&hostTIM2)
+
+// milliseconds, moved on by HAL_Delay() and by the tool
+static volatile uint32_t hostTick = 0;
+
+static inline uint32_t HAL_GetTick(void)
+{
+	return hostTick;
+}
+
+static inline void HAL_Delay(uint32_t delay)
+{
+	hostTick += delay;
+}
+
+// called on every pass of the move loop, the tools point it at their encoder and
+// control tick model
+static void hostIdleNone(void)
+{
+}
+
+static void (*hostIdle)(void) = hostIdleNone;
+
+static inline void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+	if(state == GPIO_PIN_SET)
+	{
+		port->ODR |= pin;
+	}
+	else
+	{
+		port->ODR &= ~pin;
+	}
+}
+
+static inline void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin)
+{
+	port->ODR ^= pin;
+}
+
+static inline void __disable_irq(void)
+{
+}
+
+static inline void __enable_irq(void)
+{
+}
+
+// the tools run the control tick from the move loop, so the order only matters to the compiler
+static inline void __DMB(void)
+{
+	__asm__ __volatile__("" ::: "memory");
+}
+
+#define __HAL_GPIO_EXTI_CLEAR_IT(pin) ((void)0)
+#define __HAL_GPIO_EXTI_GET_IT(pin) (pin)     //the tools only call a handler for its encoder edge
+#define __HAL_TIM_CLEAR_IT(htim, it) ((void)0)
+#define TIM_IT_UPDATE 0
+
+#endif
@@ -0,0 +1,204 @@
+/*******************************************************************************
+  * File Name          : maze_gen.cpp
+  * Description        : Makes maze corpora for the benchmarks with the generators
+  *                      in maze_gen.h, spread over all the cores. Maze i of a
+  *                      corpus comes from mazeSeed(seed, i), so a corpus is the
+  *                      same whatever the thread count. Every maze is checked
+  *                      with mazeValid() and the corpus stats go to stderr,
+  *                      the mazes go to the -o file as mazeWrite() text.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -pthread tools/maze_gen.cpp -o maze_gen
+  *   ./maze_gen [-n size] [-a backtrack|kruskal|loops|path|frontier|all]
+  *              [-l loops] [-c count] [-s seed] [-j threads] [-o file|-]
+  *   ./maze_gen -r file            checks a corpus written earlier
+  *****************************************************************************/
+#include "maze_gen.h"
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct corpusJob {
+	int size;
+	mazeAlgo algo;
+	int loops;
+	uint32_t seed;
+	int count;
+	std::vector<mazeGrid> *mazes;
+	std::atomic<int> *nextMaze;
+};
+
+/***********************************************************************************
+Function   :  corpusWorker()
+Description:  makes mazes until the corpus is done, taking the next maze number each
+              time so the threads share the work evenly
+Inputs     :  job
+Outputs    :  None
+***********************************************************************************/
+static void corpusWorker(corpusJob *job)
+{
+	uint32_t state;
+	int i;
+	
+	while((i = job->nextMaze->fetch_add(1))<job->count)
+	{
+		state = mazeSeed(job->seed,i);
+		mazeGenerate(&(*job->mazes)[i],job->size,job->algo,job->loops,&state);
+	}
+}
+
+/***********************************************************************************
+Function   :  makeCorpus()
+Description:  makes, checks and writes one corpus, and reports on it
+Inputs     :  job, thread count, output file
+Outputs    :  number of bad mazes
+***********************************************************************************/
+static int makeCorpus(corpusJob *job, int threads, FILE *out)
+{
+	std::vector<mazeGrid> mazes(job->count);
+	std::vector<std::thread> workers;
+	std::atomic<int> nextMaze(0);
+	uint64_t path = 0, frontier = 0, deadEnds = 0;
+	int bad = 0;
+	mazeStats stats;
+	
+	auto start = std::chrono::steady_clock::now();
+	job->mazes = &mazes;
+	job->nextMaze = &nextMaze;
+	for(int t = 0;t<threads;t++)
+	{
+		workers.push_back(std::thread(corpusWorker,job));
+	}
+	for(int t = 0;t<threads;t++)
+	{
+		workers[t].join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	
+	for(int i = 0;i<job->count;i++)
+	{
+		bad += (mazeValid(&mazes[i]) == 0);
+		stats = mazeMeasure(&mazes[i],0);
+		path += stats.pathLength;
+		frontier += stats.peakFrontier;
+		deadEnds += stats.deadEnds;
+		if(out != 0)
+		{
+			mazeWrite(out,&mazes[i],mazeAlgoNames[job->algo],mazeSeed(job->seed,i));
+		}
+	}
+	fprintf(stderr,"%-10s %3dx%-3d %6d mazes %8.1f path %8.1f frontier %8.1f dead ends %9.1f mazes/s %4d bad\n",
+	        mazeAlgoNames[job->algo],job->size,job->size,job->count,(double)path/job->count,
+	        (double)frontier/job->count,(double)deadEnds/job->count,job->count/seconds,bad);
+	return bad;
+}
+
+/***********************************************************************************
+Function   :  checkCorpus()
+Description:  reads a corpus back in and checks every maze in it
+Inputs     :  file
+Outputs    :  number of bad mazes
+***********************************************************************************/
+static int checkCorpus(FILE *in)
+{
+	mazeGrid maze;
+	int count = 0, bad = 0;
+	
+	while(mazeRead(in,&maze) == 1)
+	{
+		count++;
+		bad += (mazeValid(&maze) == 0);
+	}
+	fprintf(stderr,"%d mazes read, %d bad\n",count,bad);
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	corpusJob job = {16, mazeBacktrack, -1, 1, 100, 0, 0};
+	int threads = std::thread::hardware_concurrency();
+	bool all = 0;
+	int bad = 0;
+	FILE *out = 0;
+	
+	for(int i = 1;i+1<argc;i += 2)
+	{
+		if(strcmp(argv[i],"-n") == 0)
+		{
+			job.size = atoi(argv[i+1]);
+		}
+		else if(strcmp(argv[i],"-a") == 0)
+		{
+			all = (strcmp(argv[i+1],"all") == 0);
+			for(int a = 0;a<mazeAlgoCount;a++)
+			{
+				if(strcmp(argv[i+1],mazeAlgoNames[a]) == 0)
+				{
+					job.algo = (mazeAlgo)a;
+				}
+			}
+		}
+		else if(strcmp(argv[i],"-l") == 0)
+		{
+			job.loops = atoi(argv[i+1]);
+		}
+		else if(strcmp(argv[i],"-c") == 0)
+		{
+			job.count = atoi(argv[i+1]);
+		}
+		else if(strcmp(argv[i],"-s") == 0)
+		{
+			job.seed = strtoul(argv[i+1],0,0);
+		}
+		else if(strcmp(argv[i],"-j") == 0)
+		{
+			threads = atoi(argv[i+1]);
+		}
+		else if(strcmp(argv[i],"-o") == 0)
+		{
+			out = (strcmp(argv[i+1],"-") == 0) ? stdout : fopen(argv[i+1],"w");
+			if(out == 0)
+			{
+				fprintf(stderr,"can't write %s\n",argv[i+1]);
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i],"-r") == 0)
+		{
+			FILE *in = fopen(argv[i+1],"r");
+			
+			if(in == 0)
+			{
+				fprintf(stderr,"can't read %s\n",argv[i+1]);
+				return 2;
+			}
+			bad = checkCorpus(in);
+			fclose(in);
+			return (bad == 0) ? 0 : 1;
+		}
+	}
+	if((job.size<MAZE_MIN)||(job.size>MAZE_MAX)||((job.size&0x01) != 0)||(job.count<1))
+	{
+		fprintf(stderr,"size has to be even, %d to %d\n",MAZE_MIN,MAZE_MAX);
+		return 2;
+	}
+	threads = (threads<1) ? 1 : threads;
+	
+	fprintf(stderr,"%d threads, averages per maze\n",threads);
+	for(int a = 0;a<mazeAlgoCount;a++)
+	{
+		if((all == 1)||(a == job.algo))
+		{
+			corpusJob one = job;
+			one.algo = (mazeAlgo)a;
+			bad += makeCorpus(&one,threads,out);
+		}
+	}
+	if((out != 0)&&(out != stdout))
+	{
+		fclose(out);
+	}
+	return (bad == 0) ? 0 : 1;
+}
@@ -0,0 +1,621 @@
+/*******************************************************************************
+  * File Name          : maze_gen.h
+  * Description        : Seeded maze generators for the host tools, from 16x16 up
+  *                      to 64x64. Mazes use the MAP wall encoding, bits
+  *                      X,X,X,X,NORTH,EAST,SOUTH,WEST with wall=1, x growing
+  *                      toward WEST and y toward NORTH, and the goal is the
+  *                      middle four cells. Doesn't need main.cpp, so maze sizes
+  *                      aren't tied to MAP_SIZE.
+  *
+  *                      backtrack   perfect, recursive backtracker, long corridors
+  *                      kruskal     perfect, randomized Kruskal, many short branches
+  *                      loops       backtracker with walls knocked out
+  *                      path        perfect, hill climbed for the longest start to
+  *                                  goal path, the most a search can be made to travel
+  *                      frontier    loops, walls moved around for the widest flood
+  *                                  wavefront, the most a flood has queued at once
+  *****************************************************************************/
+#ifndef MAZE_GEN_H
+#define MAZE_GEN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAZE_MIN 16
+#define MAZE_MAX 64
+#define MAZE_CLIMB_TRIES 48          // hill climbing mutations per row of the maze
+
+enum mazeAlgo {mazeBacktrack,mazeKruskal,mazeLoops,mazePath,mazeFrontier,mazeAlgoCount};
+
+static const char *const mazeAlgoNames[mazeAlgoCount] = {"backtrack","kruskal","loops","path","frontier"};
+
+struct mazeGrid {
+	int size;
+	uint8_t walls[MAZE_MAX*MAZE_MAX];            // x*size+y, the same bits as cellWalls()
+};
+
+struct mazeStats {
+	uint16_t pathLength;                         // start to goal, in cells
+	uint16_t peakFrontier;                       // widest wavefront of a flood from the goal
+	uint16_t deadEnds;
+	uint16_t reachable;                          // cells reachable from the start
+};
+
+// cell offsets for NORTH, EAST, SOUTH, WEST, the same as dirDX and dirDY in main.cpp
+static const int8_t mazeDX[4] = {0,-1,0,1};
+static const int8_t mazeDY[4] = {1,0,-1,0};
+
+/***********************************************************************************
+Function   :  mazeRand()
+Description:  xorshift random numbers, the same steps as benchRand()
+Inputs     :  state, never 0
+Outputs    :  random number
+***********************************************************************************/
+static inline uint32_t mazeRand(uint32_t *state)
+{
+	*state ^= *state<<13;
+	*state ^= *state>>17;
+	*state ^= *state<<5;
+	return *state;
+}
+
+/***********************************************************************************
+Function   :  mazeSeed()
+Description:  mixes a corpus seed and a maze number into a state for mazeRand(), so
+              each maze of a corpus is the same whatever thread makes it
+Inputs     :  seed, maze number
+Outputs    :  state, never 0
+***********************************************************************************/
+static inline uint32_t mazeSeed(uint32_t seed, uint32_t index)
+{
+	uint32_t z = seed+index*0x9E3779B9u;
+	
+	z = (z^(z>>16))*0x85EBCA6Bu;
+	z = (z^(z>>13))*0xC2B2AE35u;
+	z ^= z>>16;
+	return (z == 0) ? 1 : z;
+}
+
+/***********************************************************************************
+Function   :  mazeInside()
+Description:  checks a cell is in the maze
+Inputs     :  maze, x, y
+Outputs    :  1 if inside
+***********************************************************************************/
+static inline bool mazeInside(const mazeGrid *maze, int x, int y)
+{
+	return (x>=0)&&(x<maze->size)&&(y>=0)&&(y<maze->size);
+}
+
+/***********************************************************************************
+Function   :  mazeIsGoal()
+Description:  checks if a cell is one of the middle four
+Inputs     :  maze, x, y
+Outputs    :  1 for a goal cell
+***********************************************************************************/
+static inline bool mazeIsGoal(const mazeGrid *maze, int x, int y)
+{
+	return ((x == maze->size/2-1)||(x == maze->size/2))&&((y == maze->size/2-1)||(y == maze->size/2));
+}
+
+/***********************************************************************************
+Function   :  mazeSetWall()
+Description:  puts up or takes down the wall on one side of a cell and the matching
+              side of the cell next to it
+Inputs     :  maze, x, y, direction, 1 for a wall
+Outputs    :  None
+***********************************************************************************/
+static void mazeSetWall(mazeGrid *maze, int x, int y, int d, bool wall)
+{
+	int nx = x+mazeDX[d];
+	int ny = y+mazeDY[d];
+	
+	if(wall == 1)
+	{
+		maze->walls[x*maze->size+y] |= 0x08>>d;
+		maze->walls[nx*maze->size+ny] |= 0x08>>((d+2)&0x03);
+	}
+	else
+	{
+		maze->walls[x*maze->size+y] &= ~(0x08>>d);
+		maze->walls[nx*maze->size+ny] &= ~(0x08>>((d+2)&0x03));
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeFill()
+Description:  walls up every cell
+Inputs     :  maze, size
+Outputs    :  None
+***********************************************************************************/
+static void mazeFill(mazeGrid *maze, int size)
+{
+	maze->size = size;
+	memset(maze->walls,0x0F,sizeof(maze->walls));
+}
+
+/***********************************************************************************
+Function   :  mazeBacktracker()
+Description:  perfect maze from a recursive backtracker run from the start cell
+Inputs     :  maze, size, random state
+Outputs    :  None
+***********************************************************************************/
+static void mazeBacktracker(mazeGrid *maze, int size, uint32_t *state)
+{
+	uint16_t stack[MAZE_MAX*MAZE_MAX];
+	bool visited[MAZE_MAX*MAZE_MAX] = {};
+	int top = 0;
+	int x, y, nx, ny, d, choices;
+	uint8_t options[4];
+	
+	mazeFill(maze,size);
+	visited[0] = 1;
+	stack[top++] = 0;
+	while(top>0)
+	{
+		x = stack[top-1]/size;
+		y = stack[top-1]%size;
+		choices = 0;
+		for(d = 0;d<4;d++)
+		{
+			nx = x+mazeDX[d];
+			ny = y+mazeDY[d];
+			if(mazeInside(maze,nx,ny)&&(visited[nx*size+ny] == 0))
+			{
+				options[choices++] = d;
+			}
+		}
+		if(choices == 0)
+		{
+			top--;
+			continue;
+		}
+		d = options[mazeRand(state)%choices];
+		nx = x+mazeDX[d];
+		ny = y+mazeDY[d];
+		mazeSetWall(maze,x,y,d,0);
+		visited[nx*size+ny] = 1;
+		stack[top++] = nx*size+ny;
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeFindSet()
+Description:  union find root with path halving
+Inputs     :  parents, cell
+Outputs    :  root cell
+***********************************************************************************/
+static uint16_t mazeFindSet(uint16_t *parent, uint16_t cell)
+{
+	while(parent[cell] != cell)
+	{
+		parent[cell] = parent[parent[cell]];
+		cell = parent[cell];
+	}
+	return cell;
+}
+
+/***********************************************************************************
+Function   :  mazeKruskalTree()
+Description:  perfect maze from randomized Kruskal, every inside wall in a shuffled
+              order, taken down when the cells either side aren't joined yet
+Inputs     :  maze, size, random state
+Outputs    :  None
+***********************************************************************************/
+static void mazeKruskalTree(mazeGrid *maze, int size, uint32_t *state)
+{
+	uint16_t edges[2*MAZE_MAX*MAZE_MAX];          // cell*2, +1 for its NORTH wall, +0 for its WEST wall
+	uint16_t parent[MAZE_MAX*MAZE_MAX];
+	uint16_t count = 0;
+	uint16_t swap, a, b;
+	int x, y, d;
+	
+	mazeFill(maze,size);
+	for(int cell = 0;cell<size*size;cell++)
+	{
+		parent[cell] = cell;
+		if(cell/size<size-1)
+		{
+			edges[count++] = cell*2;
+		}
+		if(cell%size<size-1)
+		{
+			edges[count++] = cell*2+1;
+		}
+	}
+	for(int i = count-1;i>0;i--)
+	{
+		b = mazeRand(state)%(i+1);
+		swap = edges[i];
+		edges[i] = edges[b];
+		edges[b] = swap;
+	}
+	for(int i = 0;i<count;i++)
+	{
+		x = (edges[i]/2)/size;
+		y = (edges[i]/2)%size;
+		d = ((edges[i]&0x01) != 0) ? 0 : 3;
+		a = mazeFindSet(parent,x*size+y);
+		b = mazeFindSet(parent,(x+mazeDX[d])*size+y+mazeDY[d]);
+		if(a != b)
+		{
+			parent[a] = b;
+			mazeSetWall(maze,x,y,d,0);
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeAddLoops()
+Description:  knocks out inside walls at random to make loops
+Inputs     :  maze, number of walls, random state
+Outputs    :  None
+***********************************************************************************/
+static void mazeAddLoops(mazeGrid *maze, int loops, uint32_t *state)
+{
+	int size = maze->size;
+	int x, y, d;
+	
+	//a maze with fewer walls left than asked for is opened right up
+	while(loops>0)
+	{
+		x = mazeRand(state)%size;
+		y = mazeRand(state)%size;
+		d = mazeRand(state)%4;
+		if(mazeInside(maze,x+mazeDX[d],y+mazeDY[d])&&(maze->walls[x*size+y]&(0x08>>d)))
+		{
+			mazeSetWall(maze,x,y,d,0);
+			loops--;
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeMeasure()
+Description:  floods the maze from the goal cells and counts what the generators and
+              the benchmarks care about
+Inputs     :  maze, where to put the flood distances (0 if not wanted)
+Outputs    :  stats, a path length of 0xFFFF if the goal can't be reached
+***********************************************************************************/
+static mazeStats mazeMeasure(const mazeGrid *maze, uint16_t *dist)
+{
+	uint16_t own[MAZE_MAX*MAZE_MAX];
+	uint16_t queue[MAZE_MAX*MAZE_MAX];
+	uint16_t head = 0, tail = 0, layerEnd, width;
+	int size = maze->size;
+	int x, y, nx, ny, open;
+	mazeStats stats = {};
+	
+	if(dist == 0)
+	{
+		dist = own;
+	}
+	memset(dist,0xFF,size*size*sizeof(uint16_t));
+	for(x = size/2-1;x<=size/2;x++)
+	{
+		for(y = size/2-1;y<=size/2;y++)
+		{
+			dist[x*size+y] = 0;
+			queue[tail++] = x*size+y;
+		}
+	}
+	
+	//a layer at a time, so the widest one is the most the flood ever queues
+	while(head != tail)
+	{
+		layerEnd = tail;
+		width = layerEnd-head;
+		stats.peakFrontier = (width>stats.peakFrontier) ? width : stats.peakFrontier;
+		while(head != layerEnd)
+		{
+			x = queue[head]/size;
+			y = queue[head]%size;
+			head++;
+			for(int d = 0;d<4;d++)
+			{
+				nx = x+mazeDX[d];
+				ny = y+mazeDY[d];
+				if(((maze->walls[x*size+y]&(0x08>>d)) == 0)&&mazeInside(maze,nx,ny)&&(dist[nx*size+ny] == 0xFFFF))
+				{
+					dist[nx*size+ny] = dist[x*size+y]+1;
+					queue[tail++] = nx*size+ny;
+				}
+			}
+		}
+	}
+	
+	stats.pathLength = dist[0];
+	for(int cell = 0;cell<size*size;cell++)
+	{
+		open = 0;
+		for(int d = 0;d<4;d++)
+		{
+			open += ((maze->walls[cell]&(0x08>>d)) == 0);
+		}
+		stats.deadEnds += (open == 1);
+		stats.reachable += ((dist[cell] != 0xFFFF)&&(dist[0] != 0xFFFF));
+	}
+	return stats;
+}
+
+/***********************************************************************************
+Function   :  mazeTreePath()
+Description:  finds the cells between two cells of a perfect maze, walking back up
+              a breadth first search from one of them
+Inputs     :  maze, from cell, to cell, where to put the cells
+Outputs    :  number of cells, both ends included
+***********************************************************************************/
+static int mazeTreePath(const mazeGrid *maze, uint16_t from, uint16_t to, uint16_t *path)
+{
+	uint16_t queue[MAZE_MAX*MAZE_MAX];
+	uint16_t parent[MAZE_MAX*MAZE_MAX];
+	uint16_t head = 0, tail = 0;
+	int size = maze->size;
+	int x, y, next, count = 0;
+	
+	memset(parent,0xFF,size*size*sizeof(uint16_t));
+	parent[from] = from;
+	queue[tail++] = from;
+	while((head != tail)&&(parent[to] == 0xFFFF))
+	{
+		x = queue[head]/size;
+		y = queue[head]%size;
+		head++;
+		for(int d = 0;d<4;d++)
+		{
+			next = (x+mazeDX[d])*size+y+mazeDY[d];
+			if(((maze->walls[x*size+y]&(0x08>>d)) == 0)&&(parent[next] == 0xFFFF))
+			{
+				parent[next] = x*size+y;
+				queue[tail++] = next;
+			}
+		}
+	}
+	for(next = to;next != from;next = parent[next])
+	{
+		path[count++] = next;
+	}
+	path[count++] = from;
+	return count;
+}
+
+/***********************************************************************************
+Function   :  mazeRandomWall()
+Description:  picks an inside wall at random, either one that is up or one that is
+              down
+Inputs     :  maze, 1 for a wall that is up, random state, where to put the cell
+              and the side
+Outputs    :  None
+***********************************************************************************/
+static void mazeRandomWall(const mazeGrid *maze, bool up, uint32_t *state, int *x, int *y, int *d)
+{
+	int size = maze->size;
+	
+	do
+	{
+		*x = mazeRand(state)%size;
+		*y = mazeRand(state)%size;
+		*d = mazeRand(state)%4;
+	}
+	while((mazeInside(maze,*x+mazeDX[*d],*y+mazeDY[*d]) == 0)||
+	      (((maze->walls[*x*size+*y]&(0x08>>*d)) != 0) != up));
+}
+
+/***********************************************************************************
+Function   :  mazeClimbPath()
+Description:  hill climbs a perfect maze toward the longest start to goal path. Each
+              try takes down a random wall, which makes one loop, and puts a wall back
+              somewhere on that loop, so the maze stays perfect. Tries that shorten
+              the path are undone, ties are kept so the climb can cross flat ground
+Inputs     :  maze, random state
+Outputs    :  None
+***********************************************************************************/
+static void mazeClimbPath(mazeGrid *maze, uint32_t *state)
+{
+	uint16_t loop[MAZE_MAX*MAZE_MAX];
+	int size = maze->size;
+	int x, y, d, length, pick, cx, cy, bx, by, bd;
+	uint16_t best = mazeMeasure(maze,0).pathLength;
+	mazeStats stats;
+	
+	for(int i = 0;i<MAZE_CLIMB_TRIES*size;i++)
+	{
+		mazeRandomWall(maze,1,state,&x,&y,&d);
+		length = mazeTreePath(maze,x*size+y,(x+mazeDX[d])*size+y+mazeDY[d],loop);
+		mazeSetWall(maze,x,y,d,0);
+		
+		//the wall back up goes between two cells next to each other on the loop
+		pick = mazeRand(state)%(length-1);
+		cx = loop[pick]/size;
+		cy = loop[pick]%size;
+		bx = loop[pick+1]/size;
+		by = loop[pick+1]%size;
+		for(bd = 0;(cx+mazeDX[bd] != bx)||(cy+mazeDY[bd] != by);bd++)
+		{
+		}
+		mazeSetWall(maze,cx,cy,bd,1);
+		
+		stats = mazeMeasure(maze,0);
+		if(stats.pathLength<best)
+		{
+			mazeSetWall(maze,cx,cy,bd,0);
+			mazeSetWall(maze,x,y,d,1);
+		}
+		else
+		{
+			best = stats.pathLength;
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeClimbFrontier()
+Description:  hill climbs a maze with loops toward the widest flood wavefront. Each
+              try moves one inside wall somewhere else, and is undone if a cell gets
+              cut off or the wavefront narrows
+Inputs     :  maze, random state
+Outputs    :  None
+***********************************************************************************/
+static void mazeClimbFrontier(mazeGrid *maze, uint32_t *state)
+{
+	int size = maze->size;
+	int ux, uy, ud, dx, dy, dd;
+	uint16_t best = mazeMeasure(maze,0).peakFrontier;
+	mazeStats stats;
+	
+	for(int i = 0;i<MAZE_CLIMB_TRIES*size;i++)
+	{
+		mazeRandomWall(maze,1,state,&dx,&dy,&dd);
+		mazeRandomWall(maze,0,state,&ux,&uy,&ud);
+		mazeSetWall(maze,dx,dy,dd,0);
+		mazeSetWall(maze,ux,uy,ud,1);
+		stats = mazeMeasure(maze,0);
+		if((stats.reachable<size*size)||(stats.peakFrontier<best))
+		{
+			mazeSetWall(maze,ux,uy,ud,0);
+			mazeSetWall(maze,dx,dy,dd,1);
+		}
+		else
+		{
+			best = stats.peakFrontier;
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeGenerate()
+Description:  makes one maze
+Inputs     :  maze, size (MAZE_MIN to MAZE_MAX, even), generator, walls to knock out
+              for loops and frontier (-1 for size*size/8), random state
+Outputs    :  None
+***********************************************************************************/
+static void mazeGenerate(mazeGrid *maze, int size, mazeAlgo algo, int loops, uint32_t *state)
+{
+	if(loops<0)
+	{
+		loops = size*size/8;
+	}
+	switch(algo)
+	{
+		case mazeKruskal:
+			mazeKruskalTree(maze,size,state);
+			break;
+		case mazePath:
+			mazeKruskalTree(maze,size,state);
+			mazeClimbPath(maze,state);
+			break;
+		case mazeLoops:
+			mazeBacktracker(maze,size,state);
+			mazeAddLoops(maze,loops,state);
+			break;
+		case mazeFrontier:
+			mazeBacktracker(maze,size,state);
+			mazeAddLoops(maze,loops,state);
+			mazeClimbFrontier(maze,state);
+			break;
+		default:
+			mazeBacktracker(maze,size,state);
+			break;
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeValid()
+Description:  checks every wall is the same from both sides, the outside is walled
+              and every cell can be reached from the start
+Inputs     :  maze
+Outputs    :  1 if good
+***********************************************************************************/
+static bool mazeValid(const mazeGrid *maze)
+{
+	int size = maze->size;
+	int nx, ny;
+	bool wall;
+	
+	for(int x = 0;x<size;x++)
+	{
+		for(int y = 0;y<size;y++)
+		{
+			for(int d = 0;d<4;d++)
+			{
+				nx = x+mazeDX[d];
+				ny = y+mazeDY[d];
+				wall = (maze->walls[x*size+y]&(0x08>>d)) != 0;
+				if((mazeInside(maze,nx,ny) == 0) ? (wall == 0) :
+				   (wall != ((maze->walls[nx*size+ny]&(0x08>>((d+2)&0x03))) != 0)))
+				{
+					return 0;
+				}
+			}
+		}
+	}
+	return mazeMeasure(maze,0).reachable == size*size;
+}
+
+/***********************************************************************************
+Function   :  mazeWrite()
+Description:  writes a maze as text, a header line then a row of hex wall digits for
+              each y from NORTH down, each row running from x = size-1 (WEST) to x = 0
+              so the file reads like the maze seen from above
+Inputs     :  file, maze, generator name, seed
+Outputs    :  None
+***********************************************************************************/
+static void mazeWrite(FILE *file, const mazeGrid *maze, const char *algo, uint32_t seed)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char row[MAZE_MAX+2];
+	int size = maze->size;
+	
+	fprintf(file,"maze %d %s %08X\n",size,algo,seed);
+	for(int y = size-1;y>=0;y--)
+	{
+		for(int x = size-1;x>=0;x--)
+		{
+			row[size-1-x] = hex[maze->walls[x*size+y]&0x0F];
+		}
+		row[size] = '\n';
+		row[size+1] = 0;
+		fputs(row,file);
+	}
+}
+
+/***********************************************************************************
+Function   :  mazeRead()
+Description:  reads the next maze written by mazeWrite()
+Inputs     :  file, maze
+Outputs    :  1 if a maze was read
+***********************************************************************************/
+static bool mazeRead(FILE *file, mazeGrid *maze)
+{
+	char line[MAZE_MAX+16];
+	char name[16];
+	unsigned seed;
+	int size, value;
+	
+	do
+	{
+		if(fgets(line,sizeof(line),file) == 0)
+		{
+			return 0;
+		}
+	}
+	while((sscanf(line,"maze %d %15s %x",&size,name,&seed) != 3)||(size<2)||(size>MAZE_MAX));
+	maze->size = size;
+	for(int y = size-1;y>=0;y--)
+	{
+		if((fgets(line,sizeof(line),file) == 0)||((int)strlen(line)<size))
+		{
+			return 0;
+		}
+		for(int x = size-1;x>=0;x--)
+		{
+			value = line[size-1-x];
+			value = (value<='9') ? value-'0' : (value&~0x20)-'A'+10;
+			maze->walls[x*size+y] = value&0x0F;
+		}
+	}
+	return 1;
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*******************************************************************************
+  * File Name          : plan_bench.cpp
+  * Description        : Counts the cells expanded by astarPath() against the
+  *                      breadth first flood the planners used before, for going
+  *                      home from every cell and for going from the start to the
+  *                      goal, on random mazes with and without loops, and times
+  *                      them along with a full distance field and pocket pruning.
+  *                      The times are the PC's, for comparing map sizes.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -DHOST_BUILD tools/plan_bench.cpp -o plan_bench
+  *   g++ -std=c++11 -O2 -DHOST_BUILD -DMAP_SIZE=32 tools/plan_bench.cpp -o plan_bench32
+  *   ./plan_bench [mazes] [seed]
+  *****************************************************************************/
+#include "../main.cpp"
+#include "bench_maze.h"
+#include <stdio.h>
+#include <time.h>
+
+static void analogRead(void)
+{
+	//the planners don't read the sensors
+}
+
+/***********************************************************************************
+Function   :  nowUs()
+Description:  monotonic time
+Inputs     :  None
+Outputs    :  microseconds
+***********************************************************************************/
+static double nowUs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec*1e6+now.tv_nsec/1e3;
+}
+
+/***********************************************************************************
+Function   :  floodCount()
+Description:  the old breadth first flood, run out from the start until the target
+              is taken off the queue
+Inputs     :  start x, y, target x, y (ASTAR_GOAL for any goal cell), where to put
+              the path length
+Outputs    :  cells expanded
+***********************************************************************************/
+static uint32_t floodCount(int sx, int sy, int tx, int ty, uint16_t *length)
+{
+	uint16_t queue[MAP_SIZE*MAP_SIZE];
+	uint16_t dist[MAP_SIZE*MAP_SIZE];
+	uint16_t head = 0;
+	uint16_t tail = 0;
+	uint32_t expanded = 0;
+	int cx, cy, nx, ny;
+
+	memset(dist,0xFF,sizeof(dist));
+	dist[sx*MAP_SIZE+sy] = 0;
+	queue[tail++] = sx*MAP_SIZE+sy;
+	while(head != tail)
+	{
+		cx = queue[head]/MAP_SIZE;
+		cy = queue[head]%MAP_SIZE;
+		head++;
+		expanded++;
+		if(((tx == ASTAR_GOAL)&&isGoalCell(cx,cy))||((cx == tx)&&(cy == ty)))
+		{
+			*length = dist[cx*MAP_SIZE+cy];
+			return expanded;
+		}
+		for(int d = 0;d<4;d++)
+		{
+			nx = cx+dirDX[d];
+			ny = cy+dirDY[d];
+			if(wallOpen(cx,cy,d)&&(dist[nx*MAP_SIZE+ny] == 0xFFFF))
+			{
+				dist[nx*MAP_SIZE+ny] = dist[cx*MAP_SIZE+cy]+1;
+				queue[tail++] = nx*MAP_SIZE+ny;
+			}
+		}
+	}
+	*length = ASTAR_NONE;
+	return expanded;
+}
+
+int main(int argc, char **argv)
+{
+	const char *names[] = {"perfect", "few loops", "many loops"};
+	const int loops[] = {0, MAP_SIZE, MAP_SIZE*MAP_SIZE/4};
+	int mazes = (argc>1) ? atoi(argv[1]) : 200;
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	uint16_t floodLength, astarLength;
+	uint32_t mismatches = 0;
+	double start, fieldUs = 0, pruneUs = 0;
+
+	benchSeed = (argc>2) ? strtoul(argv[2],0,0) : 2463534242u;
+	printf("%d random %dx%d mazes per kind, cells expanded per query\n\n",mazes,MAP_SIZE,MAP_SIZE);
+	printf("%-11s %-12s %10s %10s %8s %10s %10s\n","maze","query","flood","A*","ratio","flood us","A* us");
+
+	for(int kind = 0;kind<3;kind++)
+	{
+		uint64_t homeFlood = 0, homeAstar = 0, goalFlood = 0, goalAstar = 0;
+		double homeFloodUs = 0, homeAstarUs = 0, goalFloodUs = 0, goalAstarUs = 0;
+
+		for(int m = 0;m<mazes;m++)
+		{
+			benchMaze(loops[kind]);
+
+			//going home from every cell
+			for(int x = 0;x<MAP_SIZE;x++)
+			{
+				for(int y = 0;y<MAP_SIZE;y++)
+				{
+					start = nowUs();
+					homeFlood += floodCount(x,y,0,0,&floodLength);
+					homeFloodUs += nowUs()-start;
+					start = nowUs();
+					astarLength = astarPath(x,y,0,0,path);
+					homeAstarUs += nowUs()-start;
+					homeAstar += astarExpanded;
+					mismatches += (floodLength != astarLength);
+				}
+			}
+
+			//start to goal
+			start = nowUs();
+			goalFlood += floodCount(0,0,ASTAR_GOAL,0,&floodLength);
+			goalFloodUs += nowUs()-start;
+			start = nowUs();
+			astarLength = astarPath(0,0,ASTAR_GOAL,0,path);
+			goalAstarUs += nowUs()-start;
+			goalAstar += astarExpanded;
+			mismatches += (floodLength != astarLength);
+
+			//the whole field, and the pockets with the walls of a scanned maze
+			start = nowUs();
+			initDistField();
+			fieldUs += nowUs()-start;
+			start = nowUs();
+			pruneRegions();
+			pruneUs += nowUs()-start;
+		}
+		printf("%-11s %-12s %10.1f %10.1f %7.2fx %10.2f %10.2f\n",names[kind],"cell->home",
+		       (double)homeFlood/(mazes*MAP_SIZE*MAP_SIZE),(double)homeAstar/(mazes*MAP_SIZE*MAP_SIZE),
+		       (double)homeFlood/homeAstar,homeFloodUs/(mazes*MAP_SIZE*MAP_SIZE),homeAstarUs/(mazes*MAP_SIZE*MAP_SIZE));
+		printf("%-11s %-12s %10.1f %10.1f %7.2fx %10.2f %10.2f\n",names[kind],"start->goal",
+		       (double)goalFlood/mazes,(double)goalAstar/mazes,(double)goalFlood/goalAstar,goalFloodUs/mazes,
+		       goalAstarUs/mazes);
+	}
+	printf("\ninitDistField() %.2f us, pruneRegions() %.2f us\n",fieldUs/(3*mazes),pruneUs/(3*mazes));
+	printf("path length mismatches: %u\n",mismatches);
+	return (mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,817 @@
+/*******************************************************************************
+  * File Name          : replay.cpp
+  * Description        : Replays the input log on the PC. Each move program in the
+  *                      log is started from the state the uMouse logged, then the
+  *                      logged encoder edges, quadrature steps, wall readings and
+  *                      switches are fed through the firmware's own control tick
+  *                      and move loop. The check records and where each program
+  *                      ended up have to come out the same, bit for bit.
+  *
+  *                      With --sim the tool makes its own logs first: searches
+  *                      and speed runs on random mazes with an encoder and IR
+  *                      model, recorded by the firmware's logging, then replayed
+  *                      and timed.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -DHOST_BUILD tools/replay.cpp -o replay
+  *   st-flash read log.bin 0x08020000 126976
+  *   ./replay log.bin
+  *   ./replay --sim [ticks] [seed]
+  *****************************************************************************/
+#include "../main.cpp"
+#include "bench_maze.h"
+#include <stdio.h>
+#include <setjmp.h>
+#include <time.h>
+#include <math.h>
+
+#define SIM_EDGES_PER_DUTY 100.0     // duty for one encoder edge per control tick
+#define SIM_NOISE 2                  // IR readings wander this far either way
+#define SIM_TICK_LIMIT 2000000       // a program still running after this is stuck
+
+enum recordType {recordNone,recordTick,recordEnd,recordCut};
+
+struct logRecord {
+	recordType type;
+	uint8_t walls;                   // wall readings, as logLastWalls
+	int32_t posRight;
+	int32_t posLeft;
+	int32_t edgesRight;
+	int32_t edgesLeft;
+	bool countsDone;                 // the edges are already on the counters
+	logResult result;
+};
+
+struct replayTotals {
+	uint32_t programs;
+	uint32_t complete;
+	uint32_t cutShort;
+	uint32_t mismatches;
+	uint32_t checks;
+	uint64_t ticks;
+	uint64_t headerBytes;            // start records, snapshots, maps, programs, states and results
+};
+
+static const uint8_t *logData;
+static uint32_t logLength;
+static uint32_t logAt;
+static uint8_t logBit;               // next bit of logData[logAt]
+static logRecord next;
+static int32_t readPosRight;         // the reader's own logLastPosRight, logPastRight and so on
+static int32_t readPosLeft;
+static int32_t readPastRight[LOG_PREDICT_TICKS];
+static int32_t readPastLeft[LOG_PREDICT_TICKS];
+static uint8_t readPastAt;
+static uint8_t readWalls;
+static uint8_t replayWalls;          // wall readings of the tick being replayed
+static uint32_t replayTicks;
+static replayTotals *totals;
+static jmp_buf replayJump;
+
+static bool simulating = 0;
+static uint8_t trueWalls[MAP_SIZE][MAP_SIZE];
+static uint16_t simHead;
+static double simFracRight;
+static double simFracLeft;
+static double simPosRight;
+static double simPosLeft;
+static uint32_t simTicks;
+static jmp_buf simJump;
+
+/***********************************************************************************
+Function   :  analogRead()
+Description:  gives the control tick the readings the model works out from the real
+              walls when recording. Replaying, the log only has whether each front
+              sensor saw a wall, so the sensor reads the near end of its calibration
+              for a wall and the far end for none, which are its closest and furthest
+              distances and so come out the same
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void analogRead(void)
+{
+	uint16_t raw[IR_SENSORS];
+	uint8_t heading, walls, wall[IR_SENSORS];
+	int8_t x, y;
+	
+	if(simulating == 0)
+	{
+		for(int s = 0;s<IR_SENSORS;s++)
+		{
+			raw[s] = irCal.raw[s][IR_CAL_POINTS-1];
+		}
+		raw[IR_FL] = irCal.raw[IR_FL][(replayWalls&0x01) ? 0 : IR_CAL_POINTS-1];
+		raw[IR_M] = irCal.raw[IR_M][(replayWalls&0x02) ? 0 : IR_CAL_POINTS-1];
+		raw[IR_FR] = irCal.raw[IR_FR][(replayWalls&0x04) ? 0 : IR_CAL_POINTS-1];
+	}
+	else
+	{
+		//the side and front sensors see the cell just ahead, the back ones the cell the
+		//uMouse is in, which is the same cell while it sits in the middle of one
+		heading = ((pose.theta+0x20000000)>>30)&0x03;
+		x = poseToCell(pose.x+dirDX[heading]*(CELL_MM*128-256));
+		y = poseToCell(pose.y+dirDY[heading]*(CELL_MM*128-256));
+		walls = ((x<0)||(y<0)) ? 0x0F : trueWalls[x][y];
+		wall[IR_FL] = (walls&(0x08>>((heading+3)&0x03))) != 0;
+		wall[IR_M] = (walls&(0x08>>heading)) != 0;
+		wall[IR_FR] = (walls&(0x08>>((heading+1)&0x03))) != 0;
+		x = poseToCell(pose.x);
+		y = poseToCell(pose.y);
+		walls = ((x<0)||(y<0)) ? 0x0F : trueWalls[x][y];
+		wall[IR_BL] = (walls&(0x08>>((heading+3)&0x03))) != 0;
+		wall[IR_BR] = (walls&(0x08>>((heading+1)&0x03))) != 0;
+		for(int s = 0;s<IR_SENSORS;s++)
+		{
+			raw[s] = irCal.raw[s][(wall[s] == 1) ? 0 : IR_CAL_POINTS-1]+benchRand()%(2*SIM_NOISE+1)-SIM_NOISE;
+		}
+	}
+	analog1.leftBackIRVal = raw[IR_BL];
+	analog1.leftFrontIRVal = raw[IR_FL];
+	analog1.middleIRVal = raw[IR_M];
+	analog1.rightFrontIRVal = raw[IR_FR];
+	analog1.rightBackIRVal = raw[IR_BR];
+}
+
+/***********************************************************************************
+Function   :  readBits()
+Description:  next bits of the tick stream, first bit in bit 0
+Inputs     :  how many, where to put them
+Outputs    :  0 past the end of the log
+***********************************************************************************/
+static bool readBits(uint8_t count, uint32_t *bits)
+{
+	*bits = 0;
+	for(uint8_t i = 0;i<count;i++)
+	{
+		if(logAt>=logLength)
+		{
+			return 0;
+		}
+		*bits |= (uint32_t)((logData[logAt]>>logBit)&0x01)<<i;
+		if(++logBit == 8)
+		{
+			logBit = 0;
+			logAt++;
+		}
+	}
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  readValue()
+Description:  next signed value of a tick record
+Inputs     :  where to put the value
+Outputs    :  0 past the end of the log
+***********************************************************************************/
+static bool readValue(int32_t *value)
+{
+	uint32_t bits;
+	
+	if(readBits(1,&bits) == 0)
+	{
+		return 0;
+	}
+	if(bits == 0)
+	{
+		*value = 0;
+		return 1;
+	}
+	if(readBits(1,&bits) == 0)
+	{
+		return 0;
+	}
+	if(bits == 0)
+	{
+		*value = 1;
+		return 1;
+	}
+	if(readBits(4,&bits) == 0)
+	{
+		return 0;
+	}
+	if(bits != LOG_ESCAPE)
+	{
+		*value = (int32_t)(bits^0x08)-0x08;
+		return 1;
+	}
+	if(readBits(16,&bits) == 0)
+	{
+		return 0;
+	}
+	*value = (int16_t)bits;
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  checkRecord()
+Description:  compares a check record with the replay. It was taken at the end of a
+              tick, which is where the replay is when it reads the record
+Inputs     :  None
+Outputs    :  0 past the end of the log
+***********************************************************************************/
+static bool checkRecord(void)
+{
+	logCheck check;
+	poseEstimate now;
+	uint32_t bits;
+	
+	for(uint8_t i = 0;i<sizeof(check);i++)
+	{
+		if(readBits(8,&bits) == 0)
+		{
+			return 0;
+		}
+		((uint8_t*)&check)[i] = bits;
+	}
+	getPose(&now);
+	totals->checks++;
+	
+	//the replay started the program at the front of the ring
+
+	if((memcmp(&now,&check.pose,sizeof(now)) != 0)||(check.progHead != progHead))
+	{
+		totals->mismatches++;
+	}
+	return 1;
+}
+
+/***********************************************************************************
+Function   :  readRecord()
+Description:  reads the next tick, end or cut record, putting any switch changes on
+              the way onto the switch pins and checking any check records
+Inputs     :  where to put the record
+Outputs    :  None
+***********************************************************************************/
+static void readRecord(logRecord *record)
+{
+	uint32_t code, full, bits;
+	int32_t errRight = 0;
+	int32_t errLeft = 0;
+	
+	record->type = recordNone;
+	record->countsDone = 0;
+	record->edgesRight = 0;
+	record->edgesLeft = 0;
+	while(1)
+	{
+		if(readBits(2,&code) == 0)
+		{
+			return;
+		}
+		if(code != 0x03)
+		{
+			errRight = code&0x01;
+			errLeft = code>>1;
+			break;
+		}
+		if(readBits(1,&code) == 0)
+		{
+			return;
+		}
+		if(code == 0)
+		{
+			errRight = 1;
+			errLeft = 1;
+			break;
+		}
+		if(readBits(3,&full) == 0)
+		{
+			return;
+		}
+		if(full != 0)
+		{
+			if((readValue(&errRight) == 0)||(readValue(&errLeft) == 0))
+			{
+				return;
+			}
+			if(((full&LOG_FULL_EDGES) != 0)&&
+			   ((readValue(&record->edgesRight) == 0)||(readValue(&record->edgesLeft) == 0)))
+			{
+				return;
+			}
+			if((full&LOG_FULL_WALLS) != 0)
+			{
+				if(readBits(3,&bits) == 0)
+				{
+					return;
+				}
+				readWalls = bits;
+			}
+			break;
+		}
+		
+		//a mark
+		if(readBits(2,&code) == 0)
+		{
+			return;
+		}
+		if(code == LOG_MARK_SWITCH)
+		{
+			if(readBits(3,&bits) == 0)
+			{
+				return;
+			}
+			GPIOB->IDR = (GPIOB->IDR&~0xC0)|((bits&0x03)<<6);
+			GPIOA->IDR = (GPIOA->IDR&~0x1000)|((bits&0x04)<<10);
+			continue;
+		}
+		if(code == LOG_MARK_CHECK)
+		{
+			if(checkRecord() == 0)
+			{
+				return;
+			}
+			continue;
+		}
+		
+		//the end and cut marks are padded out to a whole byte
+		if(logBit != 0)
+		{
+			logBit = 0;
+			logAt++;
+		}
+		if(code == LOG_MARK_CUT)
+		{
+			record->type = recordCut;
+			return;
+		}
+		if(logAt+sizeof(logResult)>logLength)
+		{
+			return;
+		}
+		memcpy(&record->result,&logData[logAt],sizeof(logResult));
+		logAt += sizeof(logResult);
+		record->type = recordEnd;
+		return;
+	}
+	
+	record->posRight = ((readPosRight-readPastRight[readPastAt])>>LOG_PREDICT_SHIFT)+errRight;
+	record->posLeft = ((readPosLeft-readPastLeft[readPastAt])>>LOG_PREDICT_SHIFT)+errLeft;
+	readPastRight[readPastAt] = readPosRight;
+	readPastLeft[readPastAt] = readPosLeft;
+	readPastAt = (readPastAt+1)%LOG_PREDICT_TICKS;
+	readPosRight += record->posRight;
+	readPosLeft += record->posLeft;
+	record->walls = readWalls;
+	record->edgesRight += abs(record->posRight);
+	record->edgesLeft += abs(record->posLeft);
+	record->type = recordTick;
+}
+
+/***********************************************************************************
+Function   :  readAhead()
+Description:  reads the next record and puts its edge counts on the counters, which
+              is what the move loop sees until that tick runs
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void readAhead(void)
+{
+	readRecord(&next);
+	if(next.type == recordTick)
+	{
+		enCountRight += next.edgesRight;
+		enCountLeft += next.edgesLeft;
+		next.countsDone = 1;
+	}
+	else if(next.type == recordEnd)
+	{
+		enCountRight = next.result.enCountRight;
+		enCountLeft = next.result.enCountLeft;
+	}
+}
+
+/***********************************************************************************
+Function   :  replayTick()
+Description:  runs the next logged tick through controlTick()
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void replayTick(void)
+{
+	if(next.countsDone == 0)
+	{
+		enCountRight += next.edgesRight;
+		enCountLeft += next.edgesLeft;
+	}
+	enPosRight += next.posRight;
+	enPosLeft += next.posLeft;
+	replayWalls = next.walls;
+	controlTick();
+	replayTicks++;
+	readAhead();
+}
+
+/***********************************************************************************
+Function   :  replayStep()
+Description:  hostIdle() while replaying, one pass of the move loop for each tick.
+              Leaves the move loop if it wants more ticks than were logged
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void replayStep(void)
+{
+	if(next.type != recordTick)
+	{
+		longjmp(replayJump,1);
+	}
+	replayTick();
+}
+
+/***********************************************************************************
+Function   :  replayProgram()
+Description:  replays the move program whose start record is at logAt
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void replayProgram(void)
+{
+	logSnapshot snap;
+	logState state;
+	uint8_t program[MOVE_PROGRAM_SIZE];
+	poseEstimate now;
+	bool same;
+	
+	logAt++;
+	if(logAt+sizeof(snap)>logLength)
+	{
+		logAt = logLength;
+		return;
+	}
+	memcpy(&snap,&logData[logAt],sizeof(snap));
+	logAt += sizeof(snap);
+	if(logAt+sizeof(MAP)>logLength)
+	{
+		logAt = logLength;
+		return;
+	}
+	memcpy(&MAP,&logData[logAt],sizeof(MAP));
+	logAt += sizeof(MAP);
+	if((snap.programLength>=MOVE_PROGRAM_SIZE)||(logAt+snap.programLength+sizeof(state)>logLength))
+	{
+		logAt = logLength;
+		return;
+	}
+	memcpy(program,&logData[logAt],snap.programLength);
+	logAt += snap.programLength;
+	memcpy(&state,&logData[logAt],sizeof(state));
+	logAt += sizeof(state);
+	totals->programs++;
+	totals->headerBytes += 1+sizeof(snap)+sizeof(MAP)+snap.programLength+sizeof(state)+sizeof(logResult);
+	
+	//puts the firmware back the way it was, the turn shapes get built as they're used
+	profileIndex = snap.profileIndex;
+	Struct_Init();
+	runCurveCount = 0;
+	irCal = snap.irCal;
+	currentXpos = snap.xPos;
+	currentYpos = snap.yPos;
+	direction = snap.direction;
+	defaultDir = snap.defaultDir;
+	searchMode = snap.flags&0x01;
+	goalReached = (snap.flags>>1)&0x01;
+	frontierScoring = (snap.flags>>2)&0x01;
+	regionPruning = (snap.flags>>3)&0x01;
+	diagonalRuns = (snap.flags>>4)&0x01;
+	clearMoves();
+	for(uint16_t i = 0;i<snap.programLength;i++)
+	{
+		pushOp(program[i]);
+	}
+	enCountRight = state.enCountRight;
+	enCountLeft = state.enCountLeft;
+	enBaseRight = state.enBaseRight;
+	enBaseLeft = state.enBaseLeft;
+	enPosRight = state.enPosRight;
+	enPosLeft = state.enPosLeft;
+	lastEnPosRight = state.lastEnPosRight;
+	lastEnPosLeft = state.lastEnPosLeft;
+	pose = state.pose;
+	leftWallSeen = state.wallSeen&0x01;
+	rightWallSeen = (state.wallSeen>>1)&0x01;
+	memcpy(wallHistory,state.wallHistory,sizeof(wallHistory));
+	GPIOB->IDR = (GPIOB->IDR&~0xC0)|((state.switches&0x03)<<6);
+	GPIOA->IDR = (GPIOA->IDR&~0x1000)|((state.switches&0x04)<<10);
+	readPosRight = 0;
+	readPosLeft = 0;
+	memset(readPastRight,0,sizeof(readPastRight));
+	memset(readPastLeft,0,sizeof(readPastLeft));
+	readPastAt = 0;
+	readWalls = (state.wallHistory[0]&0x01)|((state.wallHistory[1]&0x01)<<1)|((state.wallHistory[2]&0x01)<<2);
+	replayWalls = readWalls;
+	logBit = 0;
+	replayTicks = 0;
+	
+	//the counters stay where they were logged until the move loop has taken its start
+	readRecord(&next);
+	hostIdle = replayStep;
+	if(setjmp(replayJump) == 0)
+	{
+		exeMoveVector();
+		
+		//ticks that came after the last pass of the move loop, before logStop()
+		while(next.type == recordTick)
+		{
+			replayTick();
+		}
+	}
+	hostIdle = hostIdleNone;
+	totals->ticks += replayTicks;
+	if(next.type != recordEnd)
+	{
+		//either the log ran out, or the program ran on past a logged end
+		totals->cutShort++;
+		return;
+	}
+	
+	getPose(&now);
+	same = (memcmp(&now,&next.result.pose,sizeof(now)) == 0)&&
+	       (logMapHash() == next.result.mapHash)&&
+	       (replayTicks == next.result.ticks)&&
+	       (currentXpos == next.result.xPos)&&(currentYpos == next.result.yPos)&&
+	       (direction == next.result.direction)&&(goalReached == next.result.goalReached);
+	totals->complete++;
+	totals->mismatches += (same == 0);
+}
+
+/***********************************************************************************
+Function   :  replayLog()
+Description:  replays every move program in a log
+Inputs     :  log, length, totals to add to
+Outputs    :  None
+***********************************************************************************/
+static void replayLog(const uint8_t *data, uint32_t length, replayTotals *sums)
+{
+	bool wasLogging = inputLogging;
+	
+	inputLogging = 0;
+	simulating = 0;
+	//a tick stream the power went off in runs on into the erased flash, which
+	//would read as ticks
+	while((length>0)&&(data[length-1] == LOG_BLANK))
+	{
+		length--;
+	}
+	logData = data;
+	logLength = length;
+	logAt = 0;
+	totals = sums;
+	while(logAt<logLength)
+	{
+		if(logData[logAt] == LOG_TAG_START)
+		{
+			replayProgram();
+		}
+		else
+		{
+			logAt++;
+		}
+	}
+	inputLogging = wasLogging;
+}
+
+/***********************************************************************************
+Function   :  simStep()
+Description:  hostIdle() while recording. Runs the control tick, then turns the
+              wheels through one tick of the move being run. Each wheel turns at its
+              duty, the slower one in step with the faster, and neither goes past the
+              end of its move. The in place turns are scaled to turn exactly as far as
+              they should, and the heading is squared up to the nearest eighth after
+              every move, standing in for the steering the motor code will do
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void simStep(void)
+{
+	movementVector move;
+	uint32_t doneRight, doneLeft, major;
+	int32_t edgesRight, edgesLeft, steps;
+	double rate, scale = 1;
+	
+	controlTick();
+	if(++simTicks>SIM_TICK_LIMIT)
+	{
+		logging = 0;
+		longjmp(simJump,1);
+	}
+	
+	if(progHead != simHead)
+	{
+		simHead = progHead;
+		enPosLeft -= lround((int32_t)(pose.theta-((pose.theta+(EIGHTH_TURN/2))&~(EIGHTH_TURN-1)))/(double)ANGLE_PER_STEP);
+	}
+	decodeOp(moveProgram[(progHead-1)&(MOVE_PROGRAM_SIZE-1)],&move);
+	major = (move.rightMotorSteps>move.leftMotorSteps) ? move.rightMotorSteps : move.leftMotorSteps;
+	if(major == 0)
+	{
+		return;
+	}
+	rate = ((move.rightMotorSteps>move.leftMotorSteps) ? move.pwmR1+move.pwmR2 : move.pwmL1+move.pwmL2)/SIM_EDGES_PER_DUTY;
+	if((move.moveType == turnRight)||(move.moveType == turnLeft)||(move.moveType == turnAround))
+	{
+		scale = ((move.moveType == turnAround) ? HALF_TURN : QUARTER_TURN)/(double)ANGLE_PER_STEP/
+		        ((move.pwmR2 != 0) ? move.leftMotorSteps+move.rightMotorSteps :
+		                             abs((int32_t)move.leftMotorSteps-(int32_t)move.rightMotorSteps));
+	}
+	
+	//edges, neither wheel going past the end of its move
+	doneRight = enCountRight-enBaseRight;
+	doneLeft = enCountLeft-enBaseLeft;
+	simFracRight += rate*move.rightMotorSteps/major;
+	simFracLeft += rate*move.leftMotorSteps/major;
+	edgesRight = (int32_t)simFracRight;
+	edgesLeft = (int32_t)simFracLeft;
+	simFracRight -= edgesRight;
+	simFracLeft -= edgesLeft;
+	edgesRight = (doneRight>=move.rightMotorSteps) ? 0 :
+	             (doneRight+edgesRight>move.rightMotorSteps) ? move.rightMotorSteps-doneRight : edgesRight;
+	edgesLeft = (doneLeft>=move.leftMotorSteps) ? 0 :
+	            (doneLeft+edgesLeft>move.leftMotorSteps) ? move.leftMotorSteps-doneLeft : edgesLeft;
+	enCountRight += edgesRight;
+	enCountLeft += edgesLeft;
+	
+	//quadrature steps, the way each wheel turns
+	simPosRight += ((move.pwmR1>=move.pwmR2) ? 1 : -1)*edgesRight*scale;
+	simPosLeft += ((move.pwmL1>=move.pwmL2) ? 1 : -1)*edgesLeft*scale;
+	steps = (int32_t)simPosRight;
+	simPosRight -= steps;
+	enPosRight += steps;
+	steps = (int32_t)simPosLeft;
+	simPosLeft -= steps;
+	enPosLeft += steps;
+}
+
+/***********************************************************************************
+Function   :  simRecord()
+Description:  runs one program maker with the model turning the wheels and the
+              firmware logging it
+Inputs     :  program maker, 1 to stand the uMouse in the start cell first
+Outputs    :  0 if the program got stuck
+***********************************************************************************/
+static bool simRecord(void (*program)(void), bool fromStart)
+{
+	bool ok = 1;
+	
+	simulating = 1;
+	if(fromStart == 1)
+	{
+		currentXpos = 0;
+		currentYpos = 0;
+		direction = defaultDir;
+		initPose();
+	}
+	simFracRight = 0;
+	simFracLeft = 0;
+	simPosRight = 0;
+	simPosLeft = 0;
+	simTicks = 0;
+	simHead = progHead;
+	controlTick();
+	hostIdle = simStep;
+	if(setjmp(simJump) == 0)
+	{
+		program();
+	}
+	else
+	{
+		clearMoves();
+		searchMode = 0;
+		ok = 0;
+	}
+	hostIdle = hostIdleNone;
+	simulating = 0;
+	return ok;
+}
+
+/***********************************************************************************
+Function   :  searchProgram()
+Description:  runs one search from where the uMouse is
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void searchProgram(void)
+{
+	searchRun();
+}
+
+/***********************************************************************************
+Function   :  speedRun()
+Description:  plans and runs the speed run from the start cell
+Inputs     :  None
+Outputs    :  None
+***********************************************************************************/
+static void speedRun(void)
+{
+	genRunVector();
+	exeMoveVector();
+}
+
+/***********************************************************************************
+Function   :  replayRecorded()
+Description:  replays what has been recorded so far and times it, then clears the log
+Inputs     :  totals, bytes and time to add to
+Outputs    :  None
+***********************************************************************************/
+static void replayRecorded(replayTotals *sums, uint64_t *bytes, double *seconds)
+{
+	clock_t start = clock();
+	
+	replayLog(hostLog,logUsed,sums);
+	*seconds += (double)(clock()-start)/CLOCKS_PER_SEC;
+	*bytes += logUsed;
+	logArm();
+}
+
+/***********************************************************************************
+Function   :  simulate()
+Description:  records searches and speed runs on random mazes until enough ticks have
+              been replayed
+Inputs     :  ticks to replay
+Outputs    :  replay totals
+***********************************************************************************/
+static replayTotals simulate(uint64_t target)
+{
+	const int loops[] = {0, MAP_SIZE, MAP_SIZE*MAP_SIZE/4};
+	replayTotals sums = {};
+	uint64_t bytes = 0;
+	double seconds = 0;
+	uint32_t mazes = 0, stuck = 0, runs = 0;
+	
+	defaultDir = NORTH;
+	diagonalRuns = 1;
+	loadIRCal();
+	logArm();
+	while(sums.ticks<target)
+	{
+		//a new maze, the replay between mazes leaves the firmware state as it likes
+		if(logUsed>LOG_BYTES/2)
+		{
+			replayRecorded(&sums,&bytes,&seconds);
+		}
+		profileIndex = mazes%PROFILE_COUNT;
+		Struct_Init();
+		benchMaze(loops[mazes%3]);
+		for(int x = 0;x<MAP_SIZE;x++)
+		{
+			for(int y = 0;y<MAP_SIZE;y++)
+			{
+				trueWalls[x][y] = cellWalls(x,y);
+			}
+		}
+		memset(&MAP,0,sizeof(MAP));
+		goalReached = 0;
+		initDistField();
+		clearMoves();
+		mazes++;
+		
+		stuck += (simRecord(searchProgram,1) == 0);
+		if(checkMapComplete() == 1)
+		{
+			stuck += (simRecord(speedRun,1) == 0);
+			runs++;
+		}
+		if(logUsed>0)
+		{
+			replayRecorded(&sums,&bytes,&seconds);
+		}
+	}
+	
+	printf("recorded %u searches and %u speed runs on random %dx%d mazes, %u got stuck\n",mazes,runs,
+	       MAP_SIZE,MAP_SIZE,stuck);
+	printf("log: %.0f bytes per program and %.2f bytes per tick, a full log holds %.1f s of ticks at %d ticks per second\n",
+	       (double)sums.headerBytes/sums.programs,(double)(bytes-sums.headerBytes)/sums.ticks,
+	       LOG_BYTES/((double)(bytes-sums.headerBytes)/sums.ticks)/CONTROL_RATE,CONTROL_RATE);
+	printf("replayed %llu ticks in %.3f s, %.3f s per 300k ticks\n",(unsigned long long)sums.ticks,seconds,
+	       seconds*300000/sums.ticks);
+	return sums;
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t fileLog[LOG_BYTES];
+	replayTotals sums = {};
+	FILE *file;
+	uint32_t length;
+	
+	if((argc>1)&&(strcmp(argv[1],"--sim") != 0))
+	{
+		file = fopen(argv[1],"rb");
+		if(file == 0)
+		{
+			printf("can't open %s\n",argv[1]);
+			return 2;
+		}
+		length = fread(fileLog,1,sizeof(fileLog),file);
+		fclose(file);
+		replayLog(fileLog,length,&sums);
+	}
+	else
+	{
+		benchSeed = (argc>3) ? strtoul(argv[3],0,0) : 2463534242u;
+		sums = simulate((argc>2) ? strtoull(argv[2],0,0) : 300000);
+	}
+	printf("programs %u: %u complete, %u cut short\n",sums.programs,sums.complete,sums.cutShort);
+	printf("check records %u, ticks %llu\n",sums.checks,(unsigned long long)sums.ticks);
+	printf("mismatches: %u\n",sums.mismatches);
+	return (sums.mismatches == 0) ? 0 : 1;
+}
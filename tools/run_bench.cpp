@@ -0,0 +1,239 @@
+/*******************************************************************************
+  * File Name          : run_bench.cpp
+  * Description        : Builds speed runs on random mazes with and without the
+  *                      diagonal optimizer and drives them through the odometry
+  *                      model. Every move program is checked to finish in the
+  *                      goal and never to leave the cells of its path, and the
+  *                      run times are compared with speed taken as the duty,
+  *                      along with the size of the biggest move program.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -DHOST_BUILD tools/run_bench.cpp -o run_bench
+  *   ./run_bench [mazes] [seed]
+  *****************************************************************************/
+#include "../main.cpp"
+#include "bench_maze.h"
+#include <stdio.h>
+#include <math.h>
+
+struct runResult {
+	double time;          //wheel steps over duty, summed over the moves
+	double clearance;     //closest the centre came to a post, mm
+	bool ok;              //ended in the goal and stayed on the path
+	uint16_t bytes;       //move program size
+};
+
+static bool onPath[MAP_SIZE][MAP_SIZE];
+
+static void analogRead(void)
+{
+	//the runs don't read the sensors
+}
+
+/***********************************************************************************
+Function   :  markPath()
+Description:  marks the cells genRunVector() goes through, on the same path it takes
+Inputs     :  None
+Outputs    :  goal cell x, y
+***********************************************************************************/
+static void markPath(int8_t *gx, int8_t *gy)
+{
+	uint8_t path[MAP_SIZE*MAP_SIZE];
+	uint16_t steps = knownPath(0,0,ASTAR_GOAL,0,path);
+	int8_t x = 0;
+	int8_t y = 0;
+
+	memset(onPath,0,sizeof(onPath));
+	onPath[0][0] = 1;
+	for(uint16_t i = 0;i<steps;i++)
+	{
+		x += dirDX[path[i]];
+		y += dirDY[path[i]];
+		onPath[x][y] = 1;
+	}
+	*gx = x;
+	*gy = y;
+}
+
+/***********************************************************************************
+Function   :  driveMoves()
+Description:  runs the move program through updatePose() with each wheel turning at
+              its duty. The in place turns are taken as exact, the heading is
+              squared up to the nearest eighth of a turn after every move, and an
+              orthogonal straight ends on the middle of its row or column the way
+              the wall corrections would. Diagonals have no walls to follow, so
+              they're left with whatever the turns before them gave
+Inputs     :  result to fill
+Outputs    :  None
+***********************************************************************************/
+static void driveMoves(runResult *result)
+{
+	movementVector move;
+	poseEstimate now;
+	uint32_t doneL, doneR, point, spread;
+	double rateL, rateR, fracL, fracR, px, py, d;
+
+	result->time = 0;
+	result->clearance = 1e9;
+	result->ok = 1;
+	while(decodeOp(popOp(),&move) == 1)
+	{
+		if((move.moveType == turnRight)||(move.moveType == turnLeft)||(move.moveType == turnAround))
+		{
+			pose.theta += (move.moveType == turnRight) ? QUARTER_TURN :
+			              (move.moveType == turnLeft) ? (uint32_t)-QUARTER_TURN : HALF_TURN;
+			result->time += (double)move.leftMotorSteps/profile->turnPwm;
+			continue;
+		}
+
+		doneL = 0;
+		doneR = 0;
+		fracL = 0;
+		fracR = 0;
+		result->time += (move.leftMotorSteps+move.rightMotorSteps)/2.0/((move.pwmL1+move.pwmR1)/2.0);
+		while((doneL<move.leftMotorSteps)||(doneR<move.rightMotorSteps))
+		{
+			rateL = move.pwmL1;
+			rateR = move.pwmR1;
+			if(move.curve != 0)
+			{
+				point = (uint64_t)(doneL+doneR)*CURVE_POINTS/(move.leftMotorSteps+move.rightMotorSteps);
+				spread = move.curve->spread[(point<CURVE_POINTS) ? point : CURVE_POINTS-1];
+				rateL *= (move.leftMotorSteps>move.rightMotorSteps) ? (32768.0+spread)/32768 : (32768.0-spread)/32768;
+				rateR *= (move.leftMotorSteps>move.rightMotorSteps) ? (32768.0-spread)/32768 : (32768.0+spread)/32768;
+			}
+			if(doneL<move.leftMotorSteps)
+			{
+				fracL += rateL/1000;
+			}
+			if(doneR<move.rightMotorSteps)
+			{
+				fracR += rateR/1000;
+			}
+			while(fracL>=1)
+			{
+				fracL -= 1;
+				doneL++;
+				enPosLeft++;
+			}
+			while(fracR>=1)
+			{
+				fracR -= 1;
+				doneR++;
+				enPosRight++;
+			}
+			updatePose();
+
+			//stays in the path cells and clear of the posts
+			getPose(&now);
+			px = now.x/256.0;
+			py = now.y/256.0;
+			if((poseToCell(now.x)<0)||(poseToCell(now.y)<0)||(onPath[poseToCell(now.x)][poseToCell(now.y)] == 0))
+			{
+				result->ok = 0;
+			}
+			px -= floor(px/CELL_MM+0.5)*CELL_MM;
+			py -= floor(py/CELL_MM+0.5)*CELL_MM;
+			d = sqrt(px*px+py*py);
+			if(d<result->clearance)
+			{
+				result->clearance = d;
+			}
+		}
+		pose.theta = (pose.theta+(EIGHTH_TURN/2))&~(EIGHTH_TURN-1);
+		if((move.moveType == forward)&&((pose.theta&(QUARTER_TURN-1)) == 0))
+		{
+			if((pose.theta&QUARTER_TURN) == 0)
+			{
+				pose.x = (poseToCell(pose.x)*CELL_MM+CELL_MM/2)*256;
+			}
+			else
+			{
+				pose.y = (poseToCell(pose.y)*CELL_MM+CELL_MM/2)*256;
+			}
+		}
+	}
+}
+
+/***********************************************************************************
+Function   :  runOnce()
+Description:  builds and drives the speed run from the start cell
+Inputs     :  1 for the diagonal optimizer
+Outputs    :  run result
+***********************************************************************************/
+static runResult runOnce(bool diag)
+{
+	runResult result = {};
+	poseEstimate now;
+	int8_t gx, gy;
+
+	markPath(&gx,&gy);
+	currentXpos = 0;
+	currentYpos = 0;
+	direction = defaultDir;
+	initPose();
+	diagonalRuns = diag;
+	genRunVector();
+	result.bytes = (progTail-progHead)&(MOVE_PROGRAM_SIZE-1);
+	driveMoves(&result);
+
+	//ends within a quarter cell of the middle of the goal, there are no wall corrections here
+	getPose(&now);
+	if((poseToCell(now.x) != gx)||(poseToCell(now.y) != gy)||
+	   (abs(now.x-(gx*CELL_MM+CELL_MM/2)*256)>CELL_MM/4*256)||(abs(now.y-(gy*CELL_MM+CELL_MM/2)*256)>CELL_MM/4*256))
+	{
+		result.ok = 0;
+	}
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	const char *names[] = {"perfect", "few loops", "many loops"};
+	const char *profiles[] = {"safe", "medium", "aggressive"};
+	const int loops[] = {0, MAP_SIZE, MAP_SIZE*MAP_SIZE/4};
+	int mazes = (argc>1) ? atoi(argv[1]) : 200;
+	uint32_t failures = 0;
+	runResult squares, diag;
+
+	benchSeed = (argc>2) ? strtoul(argv[2],0,0) : 2463534242u;
+	defaultDir = NORTH;
+	printf("%d random %dx%d mazes per kind, speed run time in steps per duty\n\n",mazes,MAP_SIZE,MAP_SIZE);
+	printf("%-11s %-11s %10s %10s %8s %10s %9s %9s\n","maze","profile","squares","diagonal","gain","used diag",
+	       "clearance","max bytes");
+
+	for(int kind = 0;kind<3;kind++)
+	{
+		for(int p = 0;p<3;p++)
+		{
+			double squareTime = 0, diagTime = 0, clearance = 1e9;
+			uint32_t used = 0;
+			uint16_t bytes = 0;
+
+			profileIndex = p;
+			Struct_Init();
+			benchSeed = 2463534242u+kind;
+			for(int m = 0;m<mazes;m++)
+			{
+				benchMaze(loops[kind]);
+				initDistField();
+				squares = runOnce(0);
+				diag = runOnce(1);
+				failures += (squares.ok == 0)+(diag.ok == 0);
+				squareTime += squares.time;
+				diagTime += diag.time;
+				used += (diag.time != squares.time);
+				if(diag.clearance<clearance)
+				{
+					clearance = diag.clearance;
+				}
+				bytes = (squares.bytes>bytes) ? squares.bytes : bytes;
+				bytes = (diag.bytes>bytes) ? diag.bytes : bytes;
+			}
+			printf("%-11s %-11s %10.1f %10.1f %7.1f%% %9.0f%% %7.1fmm %9u\n",names[kind],profiles[p],squareTime/mazes,
+			       diagTime/mazes,100.0*(squareTime-diagTime)/squareTime,100.0*used/mazes,clearance,bytes);
+		}
+	}
+	printf("\nruns that left the path or missed the goal: %u\n",failures);
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,405 @@
+/*******************************************************************************
+  * File Name          : run_opt.cpp
+  * Description        : Finds the fastest speed run through a fully mapped maze,
+  *                      taking longer than genRunVector() can on the uMouse. Every
+  *                      route from the start to the goal up to a few cells longer
+  *                      than the shortest is listed, shortest first. Each one is
+  *                      built as squares, as squares with the U-turns split into
+  *                      two turns, and as a diagonal run. Every program is timed
+  *                      with the profile's duties, swept turn shapes and accel
+  *                      ramp, stepping motorTick() at the control rate. The routes
+  *                      are shared out over worker processes, one per core, since
+  *                      the firmware's planners all work in its globals.
+  *
+  *                      The fastest program is written out as a runStore image
+  *                      for the flash page at RUN_STORE_ADDR, map and all. After
+  *                      a reset loadRun() puts the map back and queues it, as
+  *                      long as the profile and start direction match.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -DHOST_BUILD tools/run_opt.cpp -o run_opt
+  *   ./run_opt maze.txt [-p profile] [-d dir] [-s slack] [-k routes] [-j jobs] [-o run.bin]
+  *   st-flash write run.bin 0x0803F000
+  *
+  *   maze.txt is a maze in the maze_gen text format, the size has to be MAP_SIZE.
+  *   slack is how many cells longer than the shortest a route can be, routes is
+  *   the most routes listed.
+  *****************************************************************************/
+#include "../main.cpp"
+#include "maze_gen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+
+#define EDGES_PER_DUTY 100.0         // duty for one encoder edge per control tick, as replay.cpp's model
+#define TIME_TICK_LIMIT 600000       // a program still running after this many ticks never ends
+#define OPT_SLACK 4
+#define OPT_ROUTES 20000
+#define OPT_JOBS_MAX 64
+
+enum runVariant {variantSquares,variantSplit,variantDiagonal,variantCount};
+
+static const char *const variantNames[variantCount] = {"squares","split U-turns","diagonal"};
+
+struct optResult {
+	double seconds;
+	int32_t route;                   //-1 if the worker scored nothing
+	int32_t variant;
+	uint32_t scored;                 //programs timed
+};
+
+static std::vector<std::vector<uint8_t> > routes;
+static uint8_t routePath[MAP_SIZE*MAP_SIZE];
+static bool onRoute[MAP_SIZE*MAP_SIZE];
+
+static void analogRead(void)
+{
+	//the runs are timed without the sensors
+}
+
+/***********************************************************************************
+Function   :  findRoutes()
+Description:  lists every route from a cell to the goal that is exactly the given
+              length and doesn't go through a cell twice. The distance field cuts
+              off any branch that can't make it in time, and a route ends at the
+              first goal cell it reaches
+Inputs     :  x, y, steps so far, route length, most routes listed
+Outputs    :  None
+***********************************************************************************/
+static void findRoutes(int8_t x, int8_t y, uint16_t steps, uint16_t length, size_t limit)
+{
+	uint16_t next;
+
+	if(isGoalCell(x,y))
+	{
+		if(steps == length)
+		{
+			routes.push_back(std::vector<uint8_t>(routePath,routePath+steps));
+		}
+		return;
+	}
+	for(uint8_t d = 0;(d<4)&&(routes.size()<limit);d++)
+	{
+		if(wallOpen(x,y,d) == 0)
+		{
+			continue;
+		}
+		next = (x+dirDX[d])*MAP_SIZE+(y+dirDY[d]);
+		if((onRoute[next] == 1)||(steps+1+MAP.fillVal[next]>length))
+		{
+			continue;
+		}
+		onRoute[next] = 1;
+		routePath[steps] = d;
+		findRoutes(x+dirDX[d],y+dirDY[d],steps+1,length,limit);
+		onRoute[next] = 0;
+	}
+}
+
+/***********************************************************************************
+Function   :  timeProgram()
+Description:  runs the queued move program through the firmware's motor ramp the
+              way exeMoveVector() drives it, with the wheels turning at their duty
+              and the swept turns stepped along their shape. A move keeps the edges
+              it overshot by, like the move loop does
+Inputs     :  None
+Outputs    :  seconds, 0 if the program doesn't decode or never ends
+***********************************************************************************/
+static double timeProgram(void)
+{
+	movementVector move;
+	double right = 0, left = 0;
+	uint32_t ticks = 0;
+	uint16_t point, lastPoint;
+
+	motorDutyR = 0;
+	motorDutyL = 0;
+	setMotorMode(MOTOR_DRIVE);
+	while(decodeOp(popOp(),&move) == 1)
+	{
+		lastPoint = 0;
+		if(move.curve != 0)
+		{
+			setCurveDuty(move,0);
+		}
+		else
+		{
+			setMotorMove(move);
+		}
+		while((right<move.rightMotorSteps)||(left<move.leftMotorSteps))
+		{
+			if(++ticks>TIME_TICK_LIMIT)
+			{
+				clearMoves();
+				return 0;
+			}
+			motorTick();
+			right += abs(motorDutyR)/256.0/EDGES_PER_DUTY;
+			left += abs(motorDutyL)/256.0/EDGES_PER_DUTY;
+			if(move.curve != 0)
+			{
+				point = (uint32_t)(right+left)*CURVE_POINTS/(move.rightMotorSteps+move.leftMotorSteps);
+				if(point != lastPoint)
+				{
+					lastPoint = point;
+					setCurveDuty(move,point);
+				}
+			}
+		}
+		right -= move.rightMotorSteps;
+		left -= move.leftMotorSteps;
+	}
+
+	//a curve too tight for the profile stops the program early
+	if(progHead != progTail)
+	{
+		clearMoves();
+		return 0;
+	}
+	return (double)ticks/CONTROL_RATE;
+}
+
+/***********************************************************************************
+Function   :  buildVariant()
+Description:  queues one way of running a route. The split variant is the squares
+              program with each two cell U-turn run as two swept 90s instead
+Inputs     :  route, variant
+Outputs    :  1 if the variant applies to the route
+***********************************************************************************/
+static bool buildVariant(const std::vector<uint8_t> &route, int variant)
+{
+	uint8_t ops[MOVE_PROGRAM_SIZE];
+	uint16_t length = 0;
+	bool split = 0;
+	uint8_t op;
+
+	clearMoves();
+	if(variant == variantDiagonal)
+	{
+		return pushDiagonalMoves(&route[0],route.size(),defaultDir);
+	}
+	pushPathMoves(&route[0],route.size(),defaultDir);
+	if(variant == variantSquares)
+	{
+		return 1;
+	}
+	while(progHead != progTail)
+	{
+		ops[length++] = popOp();
+	}
+	clearMoves();
+	for(uint16_t i = 0;i<length;i++)
+	{
+		op = ops[i];
+		if(((op&OP_TURN) != 0)&&((op&OP_UTURN) == OP_UTURN))
+		{
+			pushOp(OP_CURVE90|(op&OP_LEFT));
+			pushOp(OP_CURVE90|(op&OP_LEFT));
+			split = 1;
+			continue;
+		}
+		pushOp(op);
+	}
+	return split;
+}
+
+/***********************************************************************************
+Function   :  scoreRoutes()
+Description:  times every variant of every jobs'th route from the given one
+Inputs     :  first route, route step
+Outputs    :  fastest program found
+***********************************************************************************/
+static optResult scoreRoutes(uint32_t first, uint32_t jobs)
+{
+	optResult best = {0, -1, 0, 0};
+	double seconds;
+
+	for(uint32_t r = first;r<routes.size();r += jobs)
+	{
+		for(int v = 0;v<variantCount;v++)
+		{
+			if(buildVariant(routes[r],v) == 0)
+			{
+				continue;
+			}
+			seconds = timeProgram();
+			best.scored++;
+			if((seconds>0)&&((best.route<0)||(seconds<best.seconds)))
+			{
+				best.seconds = seconds;
+				best.route = r;
+				best.variant = v;
+			}
+		}
+	}
+	return best;
+}
+
+/***********************************************************************************
+Function   :  scoreParallel()
+Description:  forks a worker for each job, each scoring its share of the routes and
+              sending back the fastest it found. Ties go to the shorter route, the
+              one listed first
+Inputs     :  jobs
+Outputs    :  fastest program found
+***********************************************************************************/
+static optResult scoreParallel(int jobs)
+{
+	int pipes[OPT_JOBS_MAX][2];
+	optResult best = {0, -1, 0, 0};
+	optResult one;
+	uint32_t scored = 0;
+
+	for(int j = 0;j<jobs;j++)
+	{
+		if(pipe(pipes[j]) != 0)
+		{
+			fprintf(stderr,"can't make a pipe\n");
+			exit(2);
+		}
+		fflush(stdout);
+		if(fork() == 0)
+		{
+			close(pipes[j][0]);
+			one = scoreRoutes(j,jobs);
+			_exit((write(pipes[j][1],&one,sizeof(one)) == sizeof(one)) ? 0 : 1);
+		}
+		close(pipes[j][1]);
+	}
+	for(int j = 0;j<jobs;j++)
+	{
+		if(read(pipes[j][0],&one,sizeof(one)) != sizeof(one))
+		{
+			fprintf(stderr,"worker %d died\n",j);
+			exit(2);
+		}
+		close(pipes[j][0]);
+		scored += one.scored;
+		if((one.route>=0)&&((best.route<0)||(one.seconds<best.seconds)||
+		   ((one.seconds == best.seconds)&&(one.route<best.route))))
+		{
+			best = one;
+		}
+	}
+	while(wait(0)>0)
+	{
+	}
+	best.scored = scored;
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mazeName = 0;
+	const char *outName = "run.bin";
+	int slack = OPT_SLACK;
+	size_t limit = OPT_ROUTES;
+	int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	mazeGrid maze;
+	optResult best;
+	double squareTime, diagTime;
+	uint16_t shortest;
+	FILE *file;
+
+	defaultDir = NORTH;
+	for(int i = 1;i<argc;i++)
+	{
+		if((argv[i][0] != '-')||(i+1 == argc))
+		{
+			mazeName = argv[i];
+			continue;
+		}
+		switch(argv[i][1])
+		{
+			case 'p': profileIndex = atoi(argv[++i])%PROFILE_COUNT; break;
+			case 'd': defaultDir = atoi(argv[++i])&0x03; break;
+			case 's': slack = atoi(argv[++i]); break;
+			case 'k': limit = atoi(argv[++i]); break;
+			case 'j': jobs = atoi(argv[++i]); break;
+			case 'o': outName = argv[++i]; break;
+			default:  i++; break;
+		}
+	}
+	jobs = (jobs<1) ? 1 : (jobs>OPT_JOBS_MAX) ? OPT_JOBS_MAX : jobs;
+	if(mazeName == 0)
+	{
+		fprintf(stderr,"usage: run_opt maze.txt [-p profile] [-d dir] [-s slack] [-k routes] [-j jobs] [-o run.bin]\n");
+		return 2;
+	}
+	file = fopen(mazeName,"r");
+	if((file == 0)||(mazeRead(file,&maze) == 0)||(maze.size != MAP_SIZE))
+	{
+		fprintf(stderr,"can't read a %dx%d maze from %s\n",MAP_SIZE,MAP_SIZE,mazeName);
+		return 2;
+	}
+	fclose(file);
+
+	//the whole maze is known, as it would be after a complete search
+	Struct_Init();
+	memset(&MAP,0,sizeof(MAP));
+	for(int x = 0;x<MAP_SIZE;x++)
+	{
+		for(int y = 0;y<MAP_SIZE;y++)
+		{
+			markWalls(x,y,0x0F,maze.walls[x*MAP_SIZE+y]);
+		}
+	}
+	memset(MAP.scanned,0xFF,sizeof(MAP.scanned));
+	initDistField();
+	shortest = MAP.fillVal[0];
+	if(shortest>=DIST_MAX)
+	{
+		fprintf(stderr,"the goal can't be reached from the start\n");
+		return 1;
+	}
+
+	//what the uMouse would run by itself
+	diagonalRuns = 0;
+	genRunVector();
+	squareTime = timeProgram();
+	diagonalRuns = 1;
+	genRunVector();
+	diagTime = timeProgram();
+
+	for(uint16_t length = shortest;(length<=shortest+slack)&&(routes.size()<limit);length++)
+	{
+		memset(onRoute,0,sizeof(onRoute));
+		onRoute[0] = 1;
+		findRoutes(0,0,0,length,limit);
+	}
+	best = scoreParallel(jobs);
+	if(best.route<0)
+	{
+		fprintf(stderr,"no route could be run with profile %d\n",profileIndex);
+		return 1;
+	}
+
+	printf("%dx%d maze, profile %d, shortest route %u cells\n",MAP_SIZE,MAP_SIZE,profileIndex,shortest);
+	printf("%u routes up to %u cells, %u programs timed on %d workers\n",(unsigned)routes.size(),
+	       shortest+slack,best.scored,jobs);
+	printf("genRunVector() squares   %8.3f s\n",squareTime);
+	printf("genRunVector() diagonal  %8.3f s\n",diagTime);
+	printf("fastest                  %8.3f s, %u cells as %s, %.3f s under the on board run\n",best.seconds,
+	       (unsigned)routes[best.route].size(),variantNames[best.variant],
+	       ((diagTime>0)&&(diagTime<squareTime) ? diagTime : squareTime)-best.seconds);
+
+	//saveRun() fills savedRun from the queued program, the flash write does nothing here
+	buildVariant(routes[best.route],best.variant);
+	saveRun();
+	if(savedRun.magic != RUN_STORE_MAGIC)
+	{
+		fprintf(stderr,"the program doesn't fit the run store\n");
+		return 1;
+	}
+	file = fopen(outName,"wb");
+	if((file == 0)||(fwrite(&savedRun,sizeof(savedRun),1,file) != 1))
+	{
+		fprintf(stderr,"can't write %s\n",outName);
+		return 2;
+	}
+	fclose(file);
+	printf("%u byte program written to %s for 0x%08X\n",savedRun.length,outName,RUN_STORE_ADDR);
+	return 0;
+}
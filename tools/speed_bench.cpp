@@ -0,0 +1,177 @@
+/*******************************************************************************
+  * File Name          : speed_bench.cpp
+  * Description        : Checks the wheel speeds wheelSpeed() works out against
+  *                      synthetic encoder waveforms. The edges go through the
+  *                      firmware's own EXTI handlers with TIM2 standing at the
+  *                      edge time plus some interrupt latency, and channel B sits
+  *                      off its quarter cycle the way a real encoder's does. Each
+  *                      wheel gets the same waveform, so the right one runs
+  *                      forward and the left one backward.
+  *
+  *                      Steady speeds from a crawl up past the fastest duty are
+  *                      checked against counting the edges of each tick, then a
+  *                      start, a top speed and a stop. Fails if the steady speed
+  *                      is out by more than SPEED_BENCH_LIMIT or the left wheel
+  *                      doesn't read backward.
+  *
+  * Build (from the repo root):
+  *   g++ -std=c++11 -O2 -DHOST_BUILD tools/speed_bench.cpp -o speed_bench
+  *   ./speed_bench [seed]
+  *****************************************************************************/
+#include "../main.cpp"
+#include "bench_maze.h"
+#include <stdio.h>
+#include <math.h>
+
+#define PHASE_B 0.20                 // channel B edges, in cycles after channel A's, 0.25 on a perfect encoder
+#define LATENCY_US 4                 // edge interrupts run up to this late
+#define SPEED_BENCH_LIMIT 2.0        // % rms error allowed at a steady speed
+#define SETTLE_TICKS 300             // ticks left out at the start of a steady speed
+
+static const double phases[4] = {0, PHASE_B, 0.5, 0.5+PHASE_B};
+
+static double cycles;                // wheel position in quadrature cycles
+static uint32_t nextEdge;            // edges so far
+static uint32_t micros;              // simulated time
+static uint32_t fireAt;              // when the interrupt of an edge that has come runs
+static bool pending;                 // an edge has come and its interrupt hasn't run
+
+static void analogRead(void)
+{
+	//only the encoders are simulated
+}
+
+/***********************************************************************************
+Function   :  fireEdge()
+Description:  sets the channel levels for an edge and runs the EXTI handler of the
+              channel that changed, for both wheels
+Inputs     :  edge number
+Outputs    :  None
+***********************************************************************************/
+static void fireEdge(uint32_t edge)
+{
+	bool a = ((edge%4) == 0)||((edge%4) == 1);
+	bool b = ((edge%4) == 1)||((edge%4) == 2);
+
+	GPIOB->IDR = (GPIOB->IDR&~0x33)|(a ? 0x11 : 0)|(b ? 0x22 : 0);
+	TIM2->CNT = micros;
+	if((edge%2) == 0)
+	{
+		EXTI0_IRQHandler();
+		EXTI4_IRQHandler();
+	}
+	else
+	{
+		EXTI1_IRQHandler();
+		EXTI9_5_IRQHandler();
+	}
+}
+
+/***********************************************************************************
+Function   :  runTick()
+Description:  turns the wheels through one control tick a microsecond at a time at
+              the given speeds, running each edge's interrupt a random latency after
+              it comes, then works the speeds out at the end of the tick
+Inputs     :  speed at the start and end of the tick, edges per second
+Outputs    :  None
+***********************************************************************************/
+static void runTick(double from, double to)
+{
+	double speed, edgeAt;
+
+	for(int us = 0;us<EDGE_TIMER_HZ/CONTROL_RATE;us++)
+	{
+		speed = from+(to-from)*us/(EDGE_TIMER_HZ/CONTROL_RATE);
+		cycles += speed/4/EDGE_TIMER_HZ;
+		micros++;
+		edgeAt = floor(nextEdge/4.0)+phases[nextEdge%4];
+		if(!pending&&(cycles>=edgeAt))
+		{
+			pending = 1;
+			fireAt = micros+benchRand()%(LATENCY_US+1);
+		}
+		if(pending&&(micros>=fireAt))
+		{
+			pending = 0;
+			fireEdge(nextEdge++);
+		}
+	}
+	TIM2->CNT = micros;
+	updateWheelSpeeds();
+}
+
+int main(int argc, char **argv)
+{
+	const double speeds[] = {20, 50, 100, 200, 500, 1000, 2000, 3000};
+	const int count = sizeof(speeds)/sizeof(speeds[0]);
+	uint32_t failures = 0;
+	uint32_t lastCount;
+	double counted, measured, countErr, speedErr, worst, lag, rampErr;
+	int n;
+
+	benchSeed = (argc>1) ? strtoul(argv[1],0,0) : 2463534242u;
+	printf("channel B at %.2f of a cycle, edge interrupts up to %d us late, errors are %% of the speed\n\n",
+	       PHASE_B,LATENCY_US);
+	printf("%10s %10s %12s %12s %12s %8s\n","edges/s","per tick","count rms","speed rms","speed worst","left");
+
+	for(int s = 0;s<count;s++)
+	{
+		countErr = 0;
+		speedErr = 0;
+		worst = 0;
+		n = 0;
+		bool backward = 1;
+
+		for(int tick = 0;tick<SETTLE_TICKS+2000;tick++)
+		{
+			lastCount = enCountRight;
+			runTick(speeds[s],speeds[s]);
+			if(tick<SETTLE_TICKS)
+			{
+				continue;
+			}
+			counted = (double)(enCountRight-lastCount)*CONTROL_RATE;
+			measured = speedRight.speed/256.0;
+			countErr += pow((counted-speeds[s])/speeds[s],2);
+			speedErr += pow((measured-speeds[s])/speeds[s],2);
+			worst = (fabs(measured-speeds[s])/speeds[s]>worst) ? fabs(measured-speeds[s])/speeds[s] : worst;
+			backward &= (speedLeft.speed == -speedRight.speed);
+			n++;
+		}
+		countErr = 100*sqrt(countErr/n);
+		speedErr = 100*sqrt(speedErr/n);
+		failures += (speedErr>SPEED_BENCH_LIMIT)+(backward == 0);
+		printf("%10.0f %10.3f %11.1f%% %11.2f%% %11.2f%% %8s\n",speeds[s],speeds[s]/CONTROL_RATE,countErr,speedErr,
+		       100*worst,(backward == 1) ? "ok" : "wrong");
+	}
+
+	//a start and a stop at about the aggressive profile's accel, 400 edges per second per second
+	for(int tick = 0;tick<500;tick++)
+	{
+		runTick(0,0);
+	}
+	rampErr = 0;
+	n = 0;
+	for(int tick = 0;tick<5000;tick++)
+	{
+		double from = (tick<2500) ? tick*0.4 : 2000-(tick-2500)*0.4;
+		double to = (tick<2500) ? (tick+1)*0.4 : 2000-(tick+1-2500)*0.4;
+
+		runTick(from,(to<0) ? 0 : to);
+		if((to>=20)&&(from>=20))
+		{
+			rampErr += pow(speedRight.speed/256.0-to,2);
+			n++;
+		}
+	}
+	lag = 0;
+	while((speedRight.speed != 0)&&(lag<1000))
+	{
+		runTick(0,0);
+		lag++;
+	}
+	printf("\nstart and stop at 400 edges/s/s: %.1f edges/s rms off, reads 0 %.0f ms after the last edge\n",
+	       sqrt(rampErr/n),lag);
+	printf("steady speeds out by more than %.1f%% or the wrong way: %u\n",SPEED_BENCH_LIMIT,failures);
+	return (failures == 0) ? 0 : 1;
+}